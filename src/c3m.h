@@ -19,6 +19,8 @@
     #define M_PI 3.14159265358979323846f
 #endif
 
+typedef uint64_t u64;
+typedef int64_t  i64;
 typedef uint32_t u32;
 typedef int32_t  i32;
 typedef uint16_t u16;
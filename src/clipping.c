@@ -1,7 +1,19 @@
 #include "clipping.h"
 
-static float signed_distance(const vertex_t* vertex, const clipping_plane_t* plane) {
-    return vec3_dot(plane->normal, vertex->position) - vec3_dot(plane->normal, plane->point);
+static float signed_distance_position(vec4 position, const clipping_plane_t* plane) {
+    return plane->x * position.x + plane->y * position.y + plane->z * position.z + plane->w * position.w;
+}
+
+static float signed_distance(const clip_vertex_t* vertex, const clipping_plane_t* plane) {
+    return signed_distance_position(vertex->position, plane);
+}
+
+u32 clip_outcode(vec4 position, const clipping_plane_t* planes, int plane_count) {
+    u32 outcode = 0;
+    for (int i = 0; i < plane_count; i++) {
+        if (!(signed_distance_position(position, &planes[i]) >= 0)) outcode |= 1u << i;
+    }
+    return outcode;
 }
 
 static u32 color_lerp(u32 color1, u32 color2, float t) {
@@ -23,25 +35,25 @@ static u32 color_lerp(u32 color1, u32 color2, float t) {
     return (r << 24) | (g << 16) | (b << 8) | a;
 }
 
-static vertex_t intersect_plane(const vertex_t* v1, const vertex_t* v2, const clipping_plane_t* plane) {
+static clip_vertex_t intersect_plane(const clip_vertex_t* v1, const clip_vertex_t* v2, const clipping_plane_t* plane) {
     float d1 = signed_distance(v1, plane);
     float d2 = signed_distance(v2, plane);
     float t = d1 / (d1 - d2);
 
-    vertex_t out;
-    out.position = vec3_lerp(v1->position, v2->position, t);
+    clip_vertex_t out;
+    out.position = vec4_lerp(v1->position, v2->position, t);
     out.normal = vec3_lerp(v1->normal, v2->normal, t);
     out.texcoord = vec2_lerp(v1->texcoord, v2->texcoord, t);   
     out.color = color_lerp(v1->color, v2->color, t);
     return out;
 }
 
-int clip_polygon_against_plane(vertex_t* polygon_vertices, int num_vertices, vertex_t* clipped_polygon_vertices, const clipping_plane_t* plane) {
+int clip_polygon_against_plane(clip_vertex_t* polygon_vertices, int num_vertices, clip_vertex_t* clipped_polygon_vertices, const clipping_plane_t* plane) {
     int num_clipped_vertices = 0;
 
     for (int i = 0; i < num_vertices; i++) {
-        vertex_t* current_vertex = &polygon_vertices[i];
-        vertex_t* prev_vertex = &polygon_vertices[(i + num_vertices - 1) % num_vertices];
+        clip_vertex_t* current_vertex = &polygon_vertices[i];
+        clip_vertex_t* prev_vertex = &polygon_vertices[(i + num_vertices - 1) % num_vertices];
 
         float current_dot = signed_distance(current_vertex, plane);
         float prev_dot = signed_distance(prev_vertex, plane);
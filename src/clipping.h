@@ -5,11 +5,20 @@
 
 #define MAX_POLYGON_VERTICES 10
 
+// polygon vertex with its position in homogeneous clip space
 typedef struct {
-    vec3 point;
+    vec4 position;
     vec3 normal;
-} clipping_plane_t;
+    vec2 texcoord;
+    u32 color;
+} clip_vertex_t;
 
-int clip_polygon_against_plane(vertex_t* polygon_vertices, int num_vertices, vertex_t* clipped_polygon_vertices, const clipping_plane_t* plane);
+// w-relative plane in clip space, a position p is inside when dot(plane, p) >= 0
+typedef vec4 clipping_plane_t;
+
+// bit i is set when the position is outside planes[i], by the same test the
+// polygon clipper uses, so a triangle with all outcodes 0 comes out of it unchanged
+u32 clip_outcode(vec4 position, const clipping_plane_t* planes, int plane_count);
+int clip_polygon_against_plane(clip_vertex_t* polygon_vertices, int num_vertices, clip_vertex_t* clipped_polygon_vertices, const clipping_plane_t* plane);
 
 #endif // CLIPPING_H
@@ -0,0 +1,154 @@
+#define _DEFAULT_SOURCE // for mmap
+#include "file.h"
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <direct.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// empty files have nothing to map, they get a valid pointer anyway
+static const char empty_file[1] = "";
+
+bool file_map(const char* path, mapped_file_t* file) {
+    *file = (mapped_file_t){0};
+
+#ifdef _WIN32
+    HANDLE handle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (handle == INVALID_HANDLE_VALUE) return false;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(handle, &size)) {
+        CloseHandle(handle);
+        return false;
+    }
+    if (size.QuadPart == 0) {
+        CloseHandle(handle);
+        file->data = empty_file;
+        return true;
+    }
+
+    HANDLE mapping = CreateFileMappingA(handle, NULL, PAGE_READONLY, 0, 0, NULL);
+    const void* data = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+    if (!data) {
+        if (mapping) CloseHandle(mapping);
+        CloseHandle(handle);
+        return false;
+    }
+
+    file->data = data;
+    file->size = (size_t)size.QuadPart;
+    file->handle = handle;
+    file->mapping = mapping;
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return false;
+    }
+    if (st.st_size == 0) {
+        close(fd);
+        file->data = empty_file;
+        return true;
+    }
+
+    // the mapping keeps the file alive after the descriptor is closed
+    void* data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) return false;
+    madvise(data, (size_t)st.st_size, MADV_SEQUENTIAL);
+
+    file->data = data;
+    file->size = (size_t)st.st_size;
+#endif
+    return true;
+}
+
+void file_unmap(mapped_file_t* file) {
+    if (file->size > 0) {
+#ifdef _WIN32
+        UnmapViewOfFile(file->data);
+        CloseHandle(file->mapping);
+        CloseHandle(file->handle);
+#else
+        munmap((void*)file->data, file->size);
+#endif
+    }
+    *file = (mapped_file_t){0};
+}
+
+bool file_stat(const char* path, u64* size, i64* mtime) {
+#ifdef _WIN32
+    struct __stat64 st;
+    if (_stat64(path, &st) != 0) return false;
+#else
+    struct stat st;
+    if (stat(path, &st) != 0) return false;
+#endif
+    *size = (u64)st.st_size;
+    *mtime = (i64)st.st_mtime;
+    return true;
+}
+
+bool file_make_directory(const char* path) {
+    char partial[512];
+    const size_t length = strlen(path);
+    if (length == 0 || length >= sizeof(partial)) return false;
+
+    // every prefix ending at a separator, then the whole path
+    for (size_t i = 1; i <= length; i++) {
+        if (i < length && path[i] != '/' && path[i] != '\\') continue;
+        memcpy(partial, path, i);
+        partial[i] = '\0';
+#ifdef _WIN32
+        _mkdir(partial);
+#else
+        mkdir(partial, 0755);
+#endif
+    }
+
+#ifdef _WIN32
+    struct __stat64 st;
+    return _stat64(path, &st) == 0 && (st.st_mode & _S_IFDIR);
+#else
+    struct stat st;
+    return stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+#endif
+}
+
+bool file_replace(const char* from, const char* to) {
+#ifdef _WIN32
+    return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    return rename(from, to) == 0;
+#endif
+}
+
+// eight bytes at a time, multiplied and folded like murmur's finalizer
+u64 file_hash(const void* data, size_t size) {
+    const u64 k = 0x9e3779b97f4a7c15ull;
+    const u8* bytes = data;
+    u64 h = size * k;
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        u64 word;
+        memcpy(&word, bytes + i, 8);
+        h = (h ^ word) * k;
+        h ^= h >> 29;
+    }
+    u64 tail = 0;
+    memcpy(&tail, bytes + i, size - i);
+    h = (h ^ tail) * k;
+    h ^= h >> 32;
+    return h;
+}
@@ -0,0 +1,31 @@
+#ifndef FILE_H
+#define FILE_H
+
+// read only memory mapped files, mmap on linux and file mappings on windows
+
+#include "c3m.h"
+#include <stddef.h>
+
+typedef struct {
+    const char* data; // not null terminated
+    size_t size;
+#ifdef _WIN32
+    void* handle;
+    void* mapping;
+#endif
+} mapped_file_t;
+
+bool file_map(const char* path, mapped_file_t* file);
+void file_unmap(mapped_file_t* file);
+
+// size and last modification time in seconds, false when the file cannot be stat'd
+bool file_stat(const char* path, u64* size, i64* mtime);
+// creates the directory and any missing parents, true when it exists afterwards
+bool file_make_directory(const char* path);
+// moves from over to, replacing it, so readers see either the old or the new file
+bool file_replace(const char* from, const char* to);
+
+// 64 bit hash of the contents, for telling files apart, not for security
+u64 file_hash(const void* data, size_t size);
+
+#endif // FILE_H
@@ -1,4 +1,23 @@
 #include "graphics.h"
+#include "tiles.h"
+#include "visibility.h"
+#include "occlusion.h"
+#include "array.h"
+
+// recomputes the hi-z entry of a block after the rasterizer wrote to it
+static inline void hiz_update_block(framebuffer_t *fb, int block_x, int block_y) {
+    const int max_x = (block_x + RASTER_BLOCK_SIZE > fb->width)  ? fb->width  : block_x + RASTER_BLOCK_SIZE;
+    const int max_y = (block_y + RASTER_BLOCK_SIZE > fb->height) ? fb->height : block_y + RASTER_BLOCK_SIZE;
+
+    float farthest = fb->depth_buffer[block_y * fb->width + block_x];
+    for (int y = block_y; y < max_y; y++) {
+        const float* row = fb->depth_buffer + y * fb->width;
+        for (int x = block_x; x < max_x; x++) {
+            farthest = (row[x] < farthest) ? row[x] : farthest;
+        }
+    }
+    fb->hiz_buffer[(block_y / RASTER_BLOCK_SIZE) * fb->hiz_width + block_x / RASTER_BLOCK_SIZE] = farthest;
+}
 
 // scalar, gouraud, textured
 #ifndef draw_triangle_sgt
@@ -68,6 +87,135 @@
 #include "triangle_template.h"
 #endif
 
+// scalar, visibility buffer
+#ifndef draw_triangle_sid
+#define RASTERIZER_NAME   draw_triangle_sid
+#define RASTER_GOURAUD    0
+#define RASTER_TEXTURE    0
+#define RASTER_VISIBILITY 1
+#include "triangle_template.h"
+#endif
+
+// scalar, visibility buffer, alpha tested
+#ifndef draw_triangle_sidt
+#define RASTERIZER_NAME   draw_triangle_sidt
+#define RASTER_GOURAUD    0
+#define RASTER_TEXTURE    1
+#define RASTER_VISIBILITY 1
+#include "triangle_template.h"
+#endif
+
+// scalar, visibility buffer, alpha tested, bilinear sampling
+#ifndef draw_triangle_sidtb
+#define RASTERIZER_NAME   draw_triangle_sidtb
+#define RASTER_GOURAUD    0
+#define RASTER_TEXTURE    1
+#define RASTER_VISIBILITY 1
+#define SAMPLE_BILINEAR
+#include "triangle_template.h"
+#endif
+
+// 8-wide variants, picked automatically by draw_triangle when the target has avx2
+#if defined(__AVX2__) && defined(__FMA__)
+#define RASTER_SIMD
+
+// simd, gouraud, textured
+#ifndef draw_triangle_vgt
+#define RASTERIZER_NAME draw_triangle_vgt
+#define RASTER_GOURAUD  1
+#define RASTER_TEXTURE  1
+#include "triangle_template_simd.h"
+#endif
+
+// simd, gouraud, colored
+#ifndef draw_triangle_vgc
+#define RASTERIZER_NAME draw_triangle_vgc
+#define RASTER_GOURAUD  1
+#define RASTER_TEXTURE  0
+#include "triangle_template_simd.h"
+#endif
+
+// simd, flat, textured
+#ifndef draw_triangle_vft
+#define RASTERIZER_NAME draw_triangle_vft
+#define RASTER_GOURAUD  0
+#define RASTER_TEXTURE  1
+#include "triangle_template_simd.h"
+#endif
+
+// simd, flat, colored
+#ifndef draw_triangle_vfc
+#define RASTERIZER_NAME draw_triangle_vfc
+#define RASTER_GOURAUD  0
+#define RASTER_TEXTURE  0
+#include "triangle_template_simd.h"
+#endif
+
+// simd, gouraud, textured, bilinear sampling
+#ifndef draw_triangle_vgtb
+#define RASTERIZER_NAME draw_triangle_vgtb
+#define RASTER_GOURAUD  1
+#define RASTER_TEXTURE  1
+#define SAMPLE_BILINEAR
+#include "triangle_template_simd.h"
+#endif
+
+// simd, gouraud, colored, bilinear sampling
+#ifndef draw_triangle_vgcb
+#define RASTERIZER_NAME draw_triangle_vgcb
+#define RASTER_GOURAUD  1
+#define RASTER_TEXTURE  0
+#define SAMPLE_BILINEAR
+#include "triangle_template_simd.h"
+#endif
+
+// simd, flat, textured, bilinear sampling
+#ifndef draw_triangle_vftb
+#define RASTERIZER_NAME draw_triangle_vftb
+#define RASTER_GOURAUD  0
+#define RASTER_TEXTURE  1
+#define SAMPLE_BILINEAR
+#include "triangle_template_simd.h"
+#endif
+
+// simd, flat, colored, bilinear sampling
+#ifndef draw_triangle_vfcb
+#define RASTERIZER_NAME draw_triangle_vfcb
+#define RASTER_GOURAUD  0
+#define RASTER_TEXTURE  0
+#define SAMPLE_BILINEAR
+#include "triangle_template_simd.h"
+#endif
+
+// simd, visibility buffer
+#ifndef draw_triangle_vid
+#define RASTERIZER_NAME   draw_triangle_vid
+#define RASTER_GOURAUD    0
+#define RASTER_TEXTURE    0
+#define RASTER_VISIBILITY 1
+#include "triangle_template_simd.h"
+#endif
+
+// simd, visibility buffer, alpha tested
+#ifndef draw_triangle_vidt
+#define RASTERIZER_NAME   draw_triangle_vidt
+#define RASTER_GOURAUD    0
+#define RASTER_TEXTURE    1
+#define RASTER_VISIBILITY 1
+#include "triangle_template_simd.h"
+#endif
+
+// simd, visibility buffer, alpha tested, bilinear sampling
+#ifndef draw_triangle_vidtb
+#define RASTERIZER_NAME   draw_triangle_vidtb
+#define RASTER_GOURAUD    0
+#define RASTER_TEXTURE    1
+#define RASTER_VISIBILITY 1
+#define SAMPLE_BILINEAR
+#include "triangle_template_simd.h"
+#endif
+#endif // __AVX2__ && __FMA__
+
 render_context render_context_init(
     int width, int height,
     float fov, float aspect_ratio, float near, float far,
@@ -81,6 +229,9 @@ render_context render_context_init(
     ctx.vertex_buffer.data = NULL;
     ctx.vertex_buffer.size = 0;
     ctx.vertex_buffer.type = GBUFFER_VERTEX;
+    ctx.vertex_streams.data = NULL;
+    ctx.vertex_streams.size = 0;
+    ctx.vertex_streams.type = GBUFFER_VERTEX_STREAMS;
     ctx.index_buffer.data = NULL;
     ctx.index_buffer.size = 0;
     ctx.index_buffer.type = GBUFFER_INDEX;
@@ -90,7 +241,20 @@ render_context render_context_init(
     ctx.blend_test = enable_blend_test;
     ctx.cull_face = enable_cull_face;
     ctx.material_id = -1;
-    ctx.frustum = frustum_init(fov, aspect_ratio, near, far);
+    ctx.frustum = frustum_init();
+    frustum_set_guard_band(&ctx.frustum, width, height);
+    ctx.guard_band = true;
+    ctx.occlusion_culling = false;
+    ctx.lod_threshold = 1.0f;
+    ctx.thread_count = 1;
+    ctx.tiles = NULL;
+    ctx.pool = NULL;
+    ctx.visibility = NULL;
+    ctx.vertex_cache = NULL;
+    ctx.vertex_cache_stamp = 0;
+    ctx.vertex_batch = NULL;
+    ctx.stats = (render_stats_t){0};
+    ctx.mipmap_mode = MIPMAP_NONE;
 
     ctx.material_manager = malloc(sizeof(material_manager_t));
     *ctx.material_manager = m_init();
@@ -103,50 +267,57 @@ framebuffer_t framebuffer_init(int width, int height) {
     fb.height = height;
     fb.color_buffer = calloc(fb.width * fb.height, sizeof(u32));
     fb.depth_buffer = calloc(fb.width * fb.height, sizeof(float));
+    fb.hiz_width = (width + RASTER_BLOCK_SIZE - 1) / RASTER_BLOCK_SIZE;
+    fb.hiz_height = (height + RASTER_BLOCK_SIZE - 1) / RASTER_BLOCK_SIZE;
+    fb.hiz_buffer = calloc(fb.hiz_width * fb.hiz_height, sizeof(float));
+    fb.id_buffer = calloc(fb.width * fb.height, sizeof(u32));
+    fb.occlusion_width = OCCLUSION_WIDTH;
+    fb.occlusion_height = OCCLUSION_HEIGHT;
+    fb.occlusion_buffer = calloc(fb.occlusion_width * fb.occlusion_height, sizeof(float));
     return fb;
 }
 
+void framebuffer_clear(framebuffer_t *fb, u32 color) {
+    for (int i = 0; i < fb->width * fb->height; i++) fb->color_buffer[i] = color;
+    memset(fb->depth_buffer, 0, fb->width * fb->height * sizeof(float));
+    memset(fb->hiz_buffer, 0, fb->hiz_width * fb->hiz_height * sizeof(float));
+    memset(fb->occlusion_buffer, 0, fb->occlusion_width * fb->occlusion_height * sizeof(float));
+}
+
 #include <stdio.h>
-frustum_t frustum_init(float fov, float aspect_ratio, float clipping_near, float clipping_far) {
+frustum_t frustum_init(void) {
     frustum_t frustum;
     clipping_plane_t *frustum_planes = frustum.planes;
 
-    float fovy = deg_to_rad(fov);
-    float fovx = atan(tan(fovy/2.0)*aspect_ratio) * 2;
-
-    float cos_half_fov_x = cos(fovx/2);
-    float sin_half_fov_x = sin(fovx/2);
-    float cos_half_fov_y = cos(fovy/2);
-    float sin_half_fov_y = sin(fovy/2);
-
-    frustum_planes[FRUSTUM_LEFT].point = vec3_zero();
-    frustum_planes[FRUSTUM_LEFT].normal.x = cos_half_fov_x;
-    frustum_planes[FRUSTUM_LEFT].normal.y = 0;
-    frustum_planes[FRUSTUM_LEFT].normal.z = sin_half_fov_x;
+    // clipping happens after the projection, where the frustum is the box
+    // -w <= x <= w, -w <= y <= w, 0 <= z <= w whatever the fov and aspect ratio
+    frustum_planes[FRUSTUM_LEFT]   = vec4_new( 1,  0,  0, 1);
+    frustum_planes[FRUSTUM_RIGHT]  = vec4_new(-1,  0,  0, 1);
+    frustum_planes[FRUSTUM_TOP]    = vec4_new( 0, -1,  0, 1);
+    frustum_planes[FRUSTUM_BOTTOM] = vec4_new( 0,  1,  0, 1);
+    frustum_planes[FRUSTUM_NEAR]   = vec4_new( 0,  0,  1, 0);
+    frustum_planes[FRUSTUM_FAR]    = vec4_new( 0,  0, -1, 1);
 
-    frustum_planes[FRUSTUM_RIGHT].point = vec3_zero();
-    frustum_planes[FRUSTUM_RIGHT].normal.x = -cos_half_fov_x;
-    frustum_planes[FRUSTUM_RIGHT].normal.y = 0;
-    frustum_planes[FRUSTUM_RIGHT].normal.z = sin_half_fov_x;
-
-    frustum_planes[FRUSTUM_TOP].point = vec3_zero();
-    frustum_planes[FRUSTUM_TOP].normal.x = 0;
-    frustum_planes[FRUSTUM_TOP].normal.y = -cos_half_fov_y;
-    frustum_planes[FRUSTUM_TOP].normal.z = sin_half_fov_y;
-    
-    frustum_planes[FRUSTUM_BOTTOM].point = vec3_zero();
-    frustum_planes[FRUSTUM_BOTTOM].normal.x = 0;
-    frustum_planes[FRUSTUM_BOTTOM].normal.y = cos_half_fov_y;
-    frustum_planes[FRUSTUM_BOTTOM].normal.z = sin_half_fov_y;
-    
-    frustum_planes[FRUSTUM_NEAR].point = vec3_new(0,0,clipping_near);
-    frustum_planes[FRUSTUM_NEAR].normal = vec3_new(0,0,1);
-    frustum_planes[FRUSTUM_FAR].point = vec3_new(0,0,clipping_far);
-    frustum_planes[FRUSTUM_FAR].normal = vec3_new(0,0,-1);
+    // no guard band until frustum_set_guard_band
+    for (int p = 0; p < 4; p++) frustum.guard_planes[p] = frustum_planes[p];
 
     return frustum;
 }
 
+// widens the side planes so they meet the screen plane RASTER_GUARD_BAND pixels from
+// the origin, on the side of the screen nearest to it
+void frustum_set_guard_band(frustum_t* frustum, int width, int height) {
+    // the band is measured from the screen center, never narrower than the screen
+    float scale_x = fmax(1.0, 2.0*RASTER_GUARD_BAND/width - 1.0);
+    float scale_y = fmax(1.0, 2.0*RASTER_GUARD_BAND/height - 1.0);
+
+    clipping_plane_t *guard_planes = frustum->guard_planes;
+    guard_planes[FRUSTUM_LEFT]   = vec4_new( 1,  0, 0, scale_x);
+    guard_planes[FRUSTUM_RIGHT]  = vec4_new(-1,  0, 0, scale_x);
+    guard_planes[FRUSTUM_TOP]    = vec4_new( 0, -1, 0, scale_y);
+    guard_planes[FRUSTUM_BOTTOM] = vec4_new( 0,  1, 0, scale_y);
+}
+
 void draw_pixel(render_context *ctx, int x, int y, u32 c) {
     if (x < 0 || x >= ctx->framebuffer.width || y < 0 || y >= ctx->framebuffer.height) return;
     ctx->framebuffer.color_buffer[y * ctx->framebuffer.width + x] = c;
@@ -225,6 +396,69 @@ void g_set_bilinear_sampling(render_context *ctx, bool enabled) {
     ctx->bilinear_sampling = enabled;
 }
 
+void g_reset_stats(render_context *ctx) {
+    ctx->stats = (render_stats_t){0};
+}
+
+void g_set_guard_band(render_context *ctx, bool enabled) {
+    ctx->guard_band = enabled;
+}
+
+void g_set_occlusion_culling(render_context *ctx, bool enabled) {
+    ctx->occlusion_culling = enabled;
+}
+
+void g_set_lod_threshold(render_context *ctx, float pixels) {
+    ctx->lod_threshold = fmaxf(0.0f, pixels);
+}
+
+void g_set_mipmap_mode(render_context *ctx, mipmap_mode_t mode) {
+    // binned triangles read the mode when they are rasterized
+    g_flush(ctx);
+    ctx->mipmap_mode = mode;
+}
+
+void g_set_thread_count(render_context *ctx, int thread_count) {
+    if (thread_count < 1) thread_count = 1;
+    if (thread_count == ctx->thread_count && (thread_count == 1 || ctx->tiles)) return;
+
+    if (ctx->tiles) {
+        g_flush(ctx);
+        tiles_destroy(ctx->tiles);
+        ctx->tiles = NULL;
+    }
+    pool_destroy(ctx->pool);
+    ctx->pool = NULL;
+
+    ctx->thread_count = thread_count;
+    if (thread_count > 1) {
+        ctx->pool = pool_create(thread_count);
+        if (ctx->pool) ctx->tiles = tiles_create(ctx->framebuffer.width, ctx->framebuffer.height, ctx->pool);
+        if (!ctx->tiles) {
+            pool_destroy(ctx->pool);
+            ctx->pool = NULL;
+            ctx->thread_count = 1;
+        }
+    }
+}
+
+void g_flush(render_context *ctx) {
+    if (ctx->tiles) tiles_flush(ctx->tiles, ctx);
+}
+
+void g_resolve_visibility(render_context *ctx) {
+    if (array_length(ctx->visibility) == 0) return;
+    g_flush(ctx);
+
+    if (ctx->tiles) {
+        tiles_dispatch(ctx->tiles, ctx, visibility_resolve);
+    } else {
+        const raster_rect_t screen = { 0, 0, ctx->framebuffer.width - 1, ctx->framebuffer.height - 1 };
+        visibility_resolve(ctx, &screen);
+    }
+    array_clear(ctx->visibility);
+}
+
 void g_bind_material(render_context *ctx, int material_id) {
     // TOOD: sanity checks
     ctx->material_id = material_id;
@@ -242,6 +476,14 @@ void g_bind_buffer(render_context *ctx, u32 type, void *data, size_t size) {
             ctx->vertex_buffer.data = data;
             ctx->vertex_buffer.size = size;
             ctx->vertex_buffer.type = type;
+            ctx->vertex_streams.data = NULL; // streams belong to the previous buffer
+            ctx->vertex_streams.size = 0;
+        } break;
+
+        case GBUFFER_VERTEX_STREAMS: {
+            ctx->vertex_streams.data = data;
+            ctx->vertex_streams.size = size;
+            ctx->vertex_streams.type = type;
         } break;
         
         default:
@@ -249,47 +491,313 @@ void g_bind_buffer(render_context *ctx, u32 type, void *data, size_t size) {
     }
 }
 
-void g_draw_mesh(render_context* ctx, mesh_t* mesh, int type, int render_mode) {
-    g_update_world_matrix(ctx, mesh->position, mesh->rotation, mesh->scale);
+static void draw_elements(render_context *ctx, u32 count, u32 *indices, int render_mode);
+static void draw_triangle_visibility(
+        render_context* ctx,
+        shader_type_t shader_type,
+        float x0, float y0, float w0, float u0, float v0, u32 c0,
+        float x1, float y1, float w1, float u1, float v1, u32 c1,
+        float x2, float y2, float w2, float u2, float v2, u32 c2);
+
+// the clip space frustum planes pulled back through the world, view and projection
+// matrices, so bounds can be tested without transforming them
+static void frustum_object_planes(const render_context* ctx, const mat4* clip_transform, vec4 planes[6]) {
+    const mat4 m = *clip_transform;
+    for (int p = 0; p < 6; p++) {
+        const vec4 q = ctx->frustum.planes[p];
+        planes[p].x = q.x * m.m[0][0] + q.y * m.m[1][0] + q.z * m.m[2][0] + q.w * m.m[3][0];
+        planes[p].y = q.x * m.m[0][1] + q.y * m.m[1][1] + q.z * m.m[2][1] + q.w * m.m[3][1];
+        planes[p].z = q.x * m.m[0][2] + q.y * m.m[1][2] + q.z * m.m[2][2] + q.w * m.m[3][2];
+        planes[p].w = q.x * m.m[0][3] + q.y * m.m[1][3] + q.z * m.m[2][3] + q.w * m.m[3][3];
+    }
+}
+
+// false when the bounds are entirely outside one of the planes: the sphere is
+// the cheap test, the box's corner farthest along the plane normal the tight one
+static bool bounds_visible(const bounds_t* b, const vec4 planes[6]) {
+    for (int p = 0; p < 6; p++) {
+        const vec3 n = { planes[p].x, planes[p].y, planes[p].z };
+        if (vec3_dot(n, b->center) + planes[p].w < -b->radius * vec3_len(n)) return false;
+
+        const vec3 corner = {
+            (n.x > 0) ? b->max.x : b->min.x,
+            (n.y > 0) ? b->max.y : b->min.y,
+            (n.z > 0) ? b->max.z : b->min.z
+        };
+        if (vec3_dot(n, corner) + planes[p].w < 0) return false;
+    }
+    return true;
+}
 
-    for (int i = 0; i < mesh->submesh_count; i++) {
-        submesh_t* sub = &mesh->submeshes[i];
-
-        material_t* mat = m_get_material(ctx->material_manager, sub->material_id);
-        ctx->current_material = mat; // set for g_draw_elements
-        bool has_texture = (mat && mat->diffuse_map_id != -1);
-
-        // TODO: flag system to not have to deal with SGT, SGC, SFT, SFC manually
-        if (has_texture) {
-            ctx->current_texture = m_get_texture(ctx->material_manager, mat->diffuse_map_id);
-
-            if (type == MESH_GOURAUD) 
-                ctx->current_shader = SHADER_SGT;
-            else
-                ctx->current_shader = SHADER_SFT;
-            
-        } else {
-            ctx->current_texture = NULL;
-            
-            if (type == MESH_GOURAUD) 
-                ctx->current_shader = SHADER_SGC;
-            else 
-                ctx->current_shader = SHADER_SFC;
+// the eye in object space, and whether a face counts as back facing when its
+// object space normal points away from it. that is the sign of the object to
+// clip space (x, y, w) determinant, which mirroring transforms turn around
+static bool camera_object_space(const render_context* ctx, vec3* eye) {
+    const mat4 transform = mat4_mul_mat4(ctx->view_matrix, ctx->world_matrix);
+    const vec4 e = mat4_mul_vec4(mat4_inverse(transform), vec4_new(0, 0, 0, 1));
+    *eye = vec3_scale(vec3_new(e.x, e.y, e.z), 1.0f / e.w);
+
+    const mat4 m = mat4_mul_mat4(ctx->projection_matrix, transform);
+    const vec3 r0 = { m.m[0][0], m.m[0][1], m.m[0][2] };
+    const vec3 r1 = { m.m[1][0], m.m[1][1], m.m[1][2] };
+    const vec3 r3 = { m.m[3][0], m.m[3][1], m.m[3][2] };
+    return vec3_dot(r0, vec3_cross(r1, r3)) > 0;
+}
+
+// false when the sphere is outside the frustum or the eye is inside the
+// normal cone, where every face of the meshlet is back facing
+static bool meshlet_visible(const meshlet_t* ml, const vec4 planes[6], const vec3* eye) {
+    for (int p = 0; p < 6; p++) {
+        const vec3 n = { planes[p].x, planes[p].y, planes[p].z };
+        if (vec3_dot(n, ml->bounds.center) + planes[p].w < -ml->bounds.radius * vec3_len(n)) return false;
+    }
+    if (eye && ml->cone_cutoff <= 1.0f) {
+        const vec3 d = vec3_sub(ml->cone_apex, *eye);
+        if (vec3_dot(d, ml->cone_axis) > ml->cone_cutoff * vec3_len(d)) return false;
+    }
+    return true;
+}
+
+// draws the submesh's visible meshlets, merging neighbouring ones so the vertex
+// stage sees as few draws as possible. with occlusion culling the first pass
+// draws what was visible last time, and the second tests the rest against the
+// occluders the first pass left behind. it also tests the meshlets the first
+// pass drew, to decide which pass they go to next time
+static void draw_meshlets(render_context* ctx, submesh_t* sub, const vec4 planes[6], const vec3* eye, const mat4* occlusion_transform, int pass, int render_mode) {
+    u32 offset = 0, count = 0;
+    for (int i = 0; i < sub->meshlet_count; i++) {
+        meshlet_t* ml = &sub->meshlets[i];
+        if (!meshlet_visible(ml, planes, eye)) {
+            if (pass == 0) {
+                ctx->stats.meshlets_culled++;
+                ctx->stats.triangles_culled += ml->index_count / 3;
+            }
+            continue;
         }
 
-        g_bind_material(ctx, sub->material_id);
-        g_bind_buffer(ctx, GBUFFER_VERTEX, mesh->vertices, mesh->vertex_count * sizeof(vertex_t));
-        g_bind_buffer(ctx, GBUFFER_INDEX, sub->indices, sub->index_count * sizeof(u32));
+        if (occlusion_transform) {
+            if (pass == 0 && ml->occluded) continue;
+            if (pass == 1) {
+                const bool drawn = !ml->occluded;
+                ml->occluded = !occlusion_box_visible(&ctx->framebuffer, occlusion_transform, ml->bounds.min, ml->bounds.max);
+                if (drawn) continue;
+                if (ml->occluded) {
+                    ctx->stats.meshlets_occluded++;
+                    ctx->stats.triangles_culled += ml->index_count / 3;
+                    continue;
+                }
+            }
+        }
+        ctx->stats.meshlets_drawn++;
 
-        g_draw_elements(ctx, sub->index_count, sub->indices, render_mode);
+        if (count > 0 && offset + count == ml->index_offset) {
+            count += ml->index_count;
+            continue;
+        }
+        if (count > 0) draw_elements(ctx, count, sub->indices + offset, render_mode);
+        offset = ml->index_offset;
+        count = ml->index_count;
+    }
+    if (count > 0) draw_elements(ctx, count, sub->indices + offset, render_mode);
+}
+
+// coarsest level of detail whose error, seen from the nearest point of the
+// submesh's bounding sphere, stays within ctx->lod_threshold pixels. NULL for
+// full detail
+static const submesh_lod_t* select_lod(const render_context* ctx, const submesh_t* sub, vec3 eye, float pixel_scale) {
+    if (ctx->lod_threshold <= 0.0f || sub->lod_count == 0) return NULL;
+    const float distance = vec3_len(vec3_sub(sub->bounds.center, eye)) - sub->bounds.radius;
+    if (distance <= 0.0f) return NULL;
+    for (int l = sub->lod_count - 1; l >= 0; l--) {
+        if (sub->lods[l].error * pixel_scale <= ctx->lod_threshold * distance) return &sub->lods[l];
+    }
+    return NULL;
+}
+
+static void bind_submesh(render_context* ctx, mesh_t* mesh, submesh_t* sub, int type) {
+    material_t* mat = m_get_material(ctx->material_manager, sub->material_id);
+    ctx->current_material = mat; // set for g_draw_elements
+    bool has_texture = (mat && mat->diffuse_map_id != -1);
+
+    // TODO: flag system to not have to deal with SGT, SGC, SFT, SFC manually
+    if (has_texture) {
+        ctx->current_texture = m_get_texture(ctx->material_manager, mat->diffuse_map_id);
+
+        if (type == MESH_GOURAUD) 
+            ctx->current_shader = SHADER_SGT;
+        else
+            ctx->current_shader = SHADER_SFT;
+        
+    } else {
+        ctx->current_texture = NULL;
+        
+        if (type == MESH_GOURAUD) 
+            ctx->current_shader = SHADER_SGC;
+        else 
+            ctx->current_shader = SHADER_SFC;
+    }
+
+    g_bind_material(ctx, sub->material_id);
+    g_bind_buffer(ctx, GBUFFER_VERTEX, mesh->vertices, mesh->vertex_count * sizeof(vertex_t));
+    if (mesh->streams.x) g_bind_buffer(ctx, GBUFFER_VERTEX_STREAMS, &mesh->streams, sizeof(vertex_streams_t));
+    g_bind_buffer(ctx, GBUFFER_INDEX, sub->indices, sub->index_count * sizeof(u32));
+}
+
+void g_draw_mesh(render_context* ctx, mesh_t* mesh, int type, int render_mode) {
+    g_update_world_matrix(ctx, mesh->position, mesh->rotation, mesh->scale);
+
+    const mat4 clip_transform = mat4_mul_mat4(ctx->projection_matrix, mat4_mul_mat4(ctx->view_matrix, ctx->world_matrix));
+    vec4 planes[6];
+    frustum_object_planes(ctx, &clip_transform, planes);
+    if (!bounds_visible(&mesh->bounds, planes)) {
+        ctx->stats.meshes_culled++;
+        ctx->stats.submeshes_culled += mesh->submesh_count;
+        for (int i = 0; i < mesh->submesh_count; i++) ctx->stats.triangles_culled += mesh->submeshes[i].index_count / 3;
+        return;
+    }
+    ctx->stats.meshes_drawn++;
+
+    // cone culling only agrees with the per triangle test in the usual orientation
+    vec3 eye;
+    const bool cone_culling = camera_object_space(ctx, &eye) && ctx->cull_face;
+
+    // pixels per object space unit at distance 1
+    const float pixel_scale = fmaxf(ctx->projection_matrix.m[0][0] * ctx->framebuffer.width, ctx->projection_matrix.m[1][1] * ctx->framebuffer.height) * 0.5f;
+
+    // occlusion culling works on meshlets, submeshes without them or drawn at
+    // a coarser level of detail are drawn in the first pass
+    const int passes = ctx->occlusion_culling ? 2 : 1;
+    for (int pass = 0; pass < passes; pass++) {
+        for (int i = 0; i < mesh->submesh_count; i++) {
+            submesh_t* sub = &mesh->submeshes[i];
+            if (!bounds_visible(&sub->bounds, planes)) {
+                if (pass == 0) {
+                    ctx->stats.submeshes_culled++;
+                    ctx->stats.triangles_culled += sub->index_count / 3;
+                }
+                continue;
+            }
+            if (pass == 0) ctx->stats.submeshes_drawn++;
+
+            const submesh_lod_t* lod = select_lod(ctx, sub, eye, pixel_scale);
+            if (lod) {
+                if (pass == 1) continue;
+                ctx->stats.submeshes_simplified++;
+                ctx->stats.triangles_simplified += (sub->index_count - lod->index_count) / 3;
+                bind_submesh(ctx, mesh, sub, type);
+                g_bind_buffer(ctx, GBUFFER_INDEX, lod->indices, lod->index_count * sizeof(u32));
+                draw_elements(ctx, lod->index_count, lod->indices, render_mode);
+                continue;
+            }
+            if (pass == 1 && sub->meshlet_count == 0) continue;
+
+            bind_submesh(ctx, mesh, sub, type);
+            if (sub->meshlet_count > 0) {
+                draw_meshlets(ctx, sub, planes, cone_culling ? &eye : NULL, ctx->occlusion_culling ? &clip_transform : NULL, pass, render_mode);
+            } else {
+                draw_elements(ctx, sub->index_count, sub->indices, render_mode);
+            }
+        }
     }
 
+    // binned triangles are rasterized once for the whole mesh
+    g_flush(ctx);
+
     // unbind
     ctx->current_material = NULL;
     ctx->current_texture = NULL;
 }
 
 void g_draw_elements(render_context *ctx, u32 count, u32 *indices, int render_mode) {
+    draw_elements(ctx, count, indices, render_mode);
+    g_flush(ctx);
+}
+
+// sizes the vertex cache to the bound vertex buffer and starts a new draw,
+// which invalidates every entry without touching them
+static transformed_vertex_t* vertex_cache_prepare(render_context *ctx) {
+    const int vertex_count = (int)(ctx->vertex_buffer.size / sizeof(vertex_t));
+    const int length = array_length(ctx->vertex_cache);
+    if (length < vertex_count) {
+        ctx->vertex_cache = array_hold(ctx->vertex_cache, vertex_count - length, sizeof(transformed_vertex_t));
+        memset(ctx->vertex_cache + length, 0, (vertex_count - length) * sizeof(transformed_vertex_t));
+    }
+
+    if (++ctx->vertex_cache_stamp == 0) {
+        memset(ctx->vertex_cache, 0, array_length(ctx->vertex_cache) * sizeof(transformed_vertex_t));
+        ctx->vertex_cache_stamp = 1;
+    }
+    return ctx->vertex_cache;
+}
+
+// view space normal of a triangle from its object space corners
+static vec3 face_normal_view(const mat3* normal_matrix, float handedness, vec3 a, vec3 b, vec3 c) {
+    vec3 n = vec3_cross(vec3_sub(b, a), vec3_sub(c, a));
+    return vec3_scale(vec3_normalize(mat3_mul_vec3(*normal_matrix, n)), handedness);
+}
+
+static void transform_vertex(transformed_vertex_t* tv, const vertex_t* v, const mat4* transform) {
+    tv->position = mat4_mul_vec4(*transform, vec3_to_vec4(v->position));
+}
+
+#ifdef RASTER_SIMD
+// one row of a matrix applied to 8 vectors plus the constant w, summed in the
+// same order as the compiled mat4_mul_vec4. with -ffast-math the compiler may
+// contract that differently, so the paths match in practice (same frame hashes
+// with and without this path), not by guarantee
+static inline __m256 simd_transform_row(const float* row, float w, __m256 x, __m256 y, __m256 z) {
+    const __m256 xw = _mm256_fmadd_ps(_mm256_set1_ps(row[0]), x, _mm256_set1_ps(w));
+    const __m256 yz = _mm256_fmadd_ps(_mm256_set1_ps(row[1]), y, _mm256_mul_ps(_mm256_set1_ps(row[2]), z));
+    return _mm256_add_ps(xw, yz);
+}
+
+// transform_vertex for 8 vertices at a time, gathered from the vertex streams.
+// returns how many vertices of the batch it processed, the rest are left to the scalar path
+static int transform_vertices_simd(transformed_vertex_t* cache, const vertex_streams_t* s, const u32* batch, int count,
+                                   const mat4* transform) {
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m256i index = _mm256_loadu_si256((const __m256i*)(batch + i));
+        const __m256 x = _mm256_i32gather_ps(s->x, index, 4);
+        const __m256 y = _mm256_i32gather_ps(s->y, index, 4);
+        const __m256 z = _mm256_i32gather_ps(s->z, index, 4);
+
+        float px[8], py[8], pz[8], pw[8];
+        _mm256_storeu_ps(px, simd_transform_row(transform->m[0], transform->m[0][3], x, y, z));
+        _mm256_storeu_ps(py, simd_transform_row(transform->m[1], transform->m[1][3], x, y, z));
+        _mm256_storeu_ps(pz, simd_transform_row(transform->m[2], transform->m[2][3], x, y, z));
+        _mm256_storeu_ps(pw, simd_transform_row(transform->m[3], transform->m[3][3], x, y, z));
+
+        for (int k = 0; k < 8; k++) {
+            transformed_vertex_t* tv = &cache[batch[i + k]];
+            tv->position = (vec4){ px[k], py[k], pz[k], pw[k] };
+        }
+    }
+    return i;
+}
+#endif // RASTER_SIMD
+
+// only triangles that cover their pixels with depth can hide what is behind
+// them: no wireframes, and no textures with transparent texels
+static bool draws_occluders(const render_context* ctx, int render_mode) {
+    if (!ctx->occlusion_culling || !ctx->depth_test) return false;
+    switch (render_mode) {
+        case 1:
+        case 3:
+            return true;
+        case 0:
+        case 4: {
+            const shader_type_t shader = ctx->current_shader;
+            if (shader != SHADER_SGT && shader != SHADER_SFT && shader != SHADER_VGT && shader != SHADER_VFT) return true;
+            const texture_t* texture = m_get_texture(ctx->material_manager, ctx->material_id);
+            return texture && !texture->alpha_tested;
+        }
+        default:
+            return false;
+    }
+}
+
+static void draw_elements(render_context *ctx, u32 count, u32 *indices, int render_mode) {
     material_t* mat = ctx->current_material;
     
     material_t default_mat = {
@@ -312,56 +820,89 @@ void g_draw_elements(render_context *ctx, u32 count, u32 *indices, int render_mo
     
     mat4 transform = mat4_mul_mat4(ctx->view_matrix, ctx->world_matrix);
     mat3 normal_matrix = mat4_to_mat3(mat4_transpose(mat4_inverse(transform)));
+    mat4 clip_transform = mat4_mul_mat4(ctx->projection_matrix, transform);
+
+    // the normal matrix maps object space cross products to view space up to the
+    // sign of the transform's determinant, which flips for mirroring transforms
+    const vec3* n = (const vec3*)normal_matrix.m;
+    const float handedness = (vec3_dot(n[0], vec3_cross(n[1], n[2])) < 0) ? -1.0f : 1.0f;
+
+    const vertex_t* vertices = ctx->vertex_buffer.data;
+    transformed_vertex_t* cache = vertex_cache_prepare(ctx);
+
+    // vertex stage: every vertex the draw references is transformed once,
+    // however many triangles share it
+    const u32 stamp = ctx->vertex_cache_stamp;
+    array_clear(ctx->vertex_batch);
+    for (u32 i = 0; i < count; i++) {
+        if (cache[indices[i]].stamp != stamp) {
+            cache[indices[i]].stamp = stamp;
+            array_push(ctx->vertex_batch, indices[i]);
+        }
+    }
+
+    const u32* batch = ctx->vertex_batch;
+    const int batch_count = array_length(ctx->vertex_batch);
+    int done = 0;
+#ifdef RASTER_SIMD
+    const vertex_streams_t* streams = ctx->vertex_streams.data;
+    if (streams) done = transform_vertices_simd(cache, streams, batch, batch_count, &clip_transform);
+#endif
+    for (int b = done; b < batch_count; b++) {
+        transform_vertex(&cache[batch[b]], &vertices[batch[b]], &clip_transform);
+    }
+    for (int b = 0; b < batch_count; b++) {
+        const vec4 position = cache[batch[b]].position;
+        cache[batch[b]].outcode = clip_outcode(position, ctx->frustum.planes, 6) |
+                                  (clip_outcode(position, ctx->frustum.guard_planes, 4) << FRUSTUM_GUARD_SHIFT);
+    }
 
+    // triangle assembly reads the transformed vertices
+    const bool occluder = draws_occluders(ctx, render_mode);
+    const float half_width  = ctx->framebuffer.width  / 2.0f;
+    const float half_height = ctx->framebuffer.height / 2.0f;
     for (u32 i = 0; i < count; i += 3) {
         u32 vi0 = indices[i+0];
         u32 vi1 = indices[i+1];
         u32 vi2 = indices[i+2];
 
-        vertex_t v0 = ((vertex_t*)ctx->vertex_buffer.data)[vi0];
-        vertex_t v1 = ((vertex_t*)ctx->vertex_buffer.data)[vi1];
-        vertex_t v2 = ((vertex_t*)ctx->vertex_buffer.data)[vi2];
+        // trivially rejected when all three vertices are outside the same plane
+        u32 outcode = cache[vi0].outcode | cache[vi1].outcode | cache[vi2].outcode;
+        if (cache[vi0].outcode & cache[vi1].outcode & cache[vi2].outcode & 0x3f) continue;
 
-        // apply world and view transformations
-        v0.position = vec4_to_vec3(mat4_mul_vec4(transform, vec3_to_vec4(v0.position)));
-        v1.position = vec4_to_vec3(mat4_mul_vec4(transform, vec3_to_vec4(v1.position)));
-        v2.position = vec4_to_vec3(mat4_mul_vec4(transform, vec3_to_vec4(v2.position)));
-
-        vec3 a = vec3_sub(v1.position, v0.position);
-        vec3 b = vec3_sub(v2.position, v0.position);
-        vec3 face_normal = vec3_normalize(vec3_cross(a, b));
+        // inside the guard band the side planes are left to the rasterizer. a triangle
+        // crossing the near plane is clipped fully, the new vertices on the near plane
+        // can end up anywhere on screen
+        if (ctx->guard_band && !(outcode & (1u << FRUSTUM_NEAR))) {
+            outcode = (outcode & (1u << FRUSTUM_FAR)) | ((outcode >> FRUSTUM_GUARD_SHIFT) & 0xf);
+        }
 
+        // back faces wind the other way on screen. in clip space that is the sign of
+        // det(xyw), the same as the view space test of the face normal against v0
+        const vec4 p0 = cache[vi0].position;
+        const vec4 p1 = cache[vi1].position;
+        const vec4 p2 = cache[vi2].position;
         if (ctx->cull_face) {
-            vec3 view_dir = vec3_normalize(v0.position);
-            if (vec3_dot(face_normal, view_dir) > 0) {
+            const vec3 h0 = {p0.x, p0.y, p0.w};
+            const vec3 h1 = {p1.x, p1.y, p1.w};
+            const vec3 h2 = {p2.x, p2.y, p2.w};
+            if (vec3_dot(h0, vec3_cross(h1, h2)) > 0) {
                 continue;
             }
         }
 
+        clip_vertex_t v0 = { p0, vertices[vi0].normal, vertices[vi0].texcoord, 0 };
+        clip_vertex_t v1 = { p1, vertices[vi1].normal, vertices[vi1].texcoord, 0 };
+        clip_vertex_t v2 = { p2, vertices[vi2].normal, vertices[vi2].texcoord, 0 };
+
         v0.color = 0xff00ff00;
         v1.color = 0xff00ff00;
         v2.color = 0xff00ff00;
 
         switch (ctx->current_shader) {
-            
-            case SHADER_SGC: {
-                vec3 n0 = vec3_normalize(mat3_mul_vec3(normal_matrix, v0.normal));
-                vec3 n1 = vec3_normalize(mat3_mul_vec3(normal_matrix, v1.normal));
-                vec3 n2 = vec3_normalize(mat3_mul_vec3(normal_matrix, v2.normal));
-
-                vec3 amb = vec3_mul(mat->ambient, ambient_light_color);
-                
-                vec3 c0_f = vec3_add(amb, vec3_scale(vec3_mul(mat->diffuse, diffuse_light_color), fmax(0.0, vec3_dot(n0, light_dir_view))));
-                vec3 c1_f = vec3_add(amb, vec3_scale(vec3_mul(mat->diffuse, diffuse_light_color), fmax(0.0, vec3_dot(n1, light_dir_view))));
-                vec3 c2_f = vec3_add(amb, vec3_scale(vec3_mul(mat->diffuse, diffuse_light_color), fmax(0.0, vec3_dot(n2, light_dir_view))));
-                
-                v0.color = pack_color(c0_f);
-                v1.color = pack_color(c1_f);
-                v2.color = pack_color(c2_f);
-                break;
-            }
-
-            case SHADER_SFC: {
+            case SHADER_SFC:
+            case SHADER_VFC: {
+                vec3 face_normal = face_normal_view(&normal_matrix, handedness, vertices[vi0].position, vertices[vi1].position, vertices[vi2].position);
                 vec3 amb = vec3_mul(mat->ambient, ambient_light_color);
                 vec3 c_f = vec3_add(amb, vec3_scale(vec3_mul(mat->diffuse, diffuse_light_color), fmax(0.0, vec3_dot(face_normal, light_dir_view))));
                 
@@ -372,22 +913,9 @@ void g_draw_elements(render_context *ctx, u32 count, u32 *indices, int render_mo
                 break;
             }
 
-            case SHADER_SGT: {
-                vec3 n0 = vec3_normalize(mat3_mul_vec3(normal_matrix, v0.normal));
-                vec3 n1 = vec3_normalize(mat3_mul_vec3(normal_matrix, v1.normal));
-                vec3 n2 = vec3_normalize(mat3_mul_vec3(normal_matrix, v2.normal));
-
-                vec3 c0_f = vec3_add(ambient_light_color, vec3_scale(diffuse_light_color, fmax(0.0, vec3_dot(n0, light_dir_view))));
-                vec3 c1_f = vec3_add(ambient_light_color, vec3_scale(diffuse_light_color, fmax(0.0, vec3_dot(n1, light_dir_view))));
-                vec3 c2_f = vec3_add(ambient_light_color, vec3_scale(diffuse_light_color, fmax(0.0, vec3_dot(n2, light_dir_view))));
-
-                v0.color = pack_color(c0_f);
-                v1.color = pack_color(c1_f);
-                v2.color = pack_color(c2_f);
-                break;
-            }
-
-            case SHADER_SFT: {
+            case SHADER_SFT:
+            case SHADER_VFT: {
+                vec3 face_normal = face_normal_view(&normal_matrix, handedness, vertices[vi0].position, vertices[vi1].position, vertices[vi2].position);
                 vec3 c_f = vec3_add(ambient_light_color, vec3_scale(diffuse_light_color, fmax(0.0, vec3_dot(face_normal, light_dir_view))));
                 
                 u32 face_color = pack_color(c_f);
@@ -396,17 +924,22 @@ void g_draw_elements(render_context *ctx, u32 count, u32 *indices, int render_mo
                 v2.color = face_color;
                 break;
             }
+
+            default:
+                break; // gouraud lighting would be overwritten below, so it is not computed
         }
         
         v0.color = 0xffffffff;
         v1.color = 0xffffffff;
         v2.color = 0xffffffff;
 
-        vertex_t polygon_vertices[MAX_POLYGON_VERTICES] = {v0, v1, v2};
+        clip_vertex_t polygon_vertices[MAX_POLYGON_VERTICES] = {v0, v1, v2};
         int num_vertices = 3;
 
-        for (int p = 0; p < 6; p++) {
-            vertex_t clipped_vertices[MAX_POLYGON_VERTICES];
+        // only triangles straddling a plane are clipped, and only against the planes they cross
+        for (int p = 0; p < 6 && (outcode & 0x3f); p++) {
+            if (!(outcode & (1u << p))) continue;
+            clip_vertex_t clipped_vertices[MAX_POLYGON_VERTICES];
             num_vertices = clip_polygon_against_plane(polygon_vertices, num_vertices, clipped_vertices, &ctx->frustum.planes[p]);
             for (int j = 0; j < num_vertices; j++) {
                 polygon_vertices[j] = clipped_vertices[j];
@@ -415,38 +948,41 @@ void g_draw_elements(render_context *ctx, u32 count, u32 *indices, int render_mo
 
         if (num_vertices < 3) continue;
 
-        for (int j = 1; j < num_vertices - 1; j++) {
-            vertex_t tv0 = polygon_vertices[0];
-            vertex_t tv1 = polygon_vertices[j];
-            vertex_t tv2 = polygon_vertices[j + 1];
-
-            vec4 pv0 = mat4_mul_vec4_project(ctx->projection_matrix, vec3_to_vec4(tv0.position));
-            vec4 pv1 = mat4_mul_vec4_project(ctx->projection_matrix, vec3_to_vec4(tv1.position));
-            vec4 pv2 = mat4_mul_vec4_project(ctx->projection_matrix, vec3_to_vec4(tv2.position));
-
-            pv0.x *= -1.0f; pv1.x *= -1.0f; pv2.x *= -1.0f;
-            pv0.y *= -1.0f; pv1.y *= -1.0f; pv2.y *= -1.0f;
-
-            float screen0_x = (pv0.x * (ctx->framebuffer.width  / 2.0f)) + (ctx->framebuffer.width  / 2.0f);
-            float screen0_y = (pv0.y * (ctx->framebuffer.height / 2.0f)) + (ctx->framebuffer.height / 2.0f);
+        // perspective divide and viewport transform in one step, once per polygon
+        // vertex. x and y are flipped, w stays for perspective correction
+        float screen_x[MAX_POLYGON_VERTICES], screen_y[MAX_POLYGON_VERTICES], screen_w[MAX_POLYGON_VERTICES];
+        for (int j = 0; j < num_vertices; j++) {
+            const vec4 p = polygon_vertices[j].position;
+            const float rcp_w = 1.0f / p.w;
+            screen_x[j] = half_width  - p.x * rcp_w * half_width;
+            screen_y[j] = half_height - p.y * rcp_w * half_height;
+            screen_w[j] = p.w;
+        }
 
-            float screen1_x = (pv1.x * (ctx->framebuffer.width  / 2.0f)) + (ctx->framebuffer.width  / 2.0f);
-            float screen1_y = (pv1.y * (ctx->framebuffer.height / 2.0f)) + (ctx->framebuffer.height / 2.0f);
+        for (int j = 1; j < num_vertices - 1; j++) {
+            const clip_vertex_t tv0 = polygon_vertices[0];
+            const clip_vertex_t tv1 = polygon_vertices[j];
+            const clip_vertex_t tv2 = polygon_vertices[j + 1];
 
-            float screen2_x = (pv2.x * (ctx->framebuffer.width  / 2.0f)) + (ctx->framebuffer.width  / 2.0f);
-            float screen2_y = (pv2.y * (ctx->framebuffer.height / 2.0f)) + (ctx->framebuffer.height / 2.0f);
+            const float screen0_x = screen_x[0],     screen0_y = screen_y[0],     screen0_w = screen_w[0];
+            const float screen1_x = screen_x[j],     screen1_y = screen_y[j],     screen1_w = screen_w[j];
+            const float screen2_x = screen_x[j + 1], screen2_y = screen_y[j + 1], screen2_w = screen_w[j + 1];
 
             u32 material_color = mat->color;
 
+            if (occluder) {
+                occlusion_draw_triangle(&ctx->framebuffer, screen0_x, screen0_y, screen0_w, screen1_x, screen1_y, screen1_w, screen2_x, screen2_y, screen2_w);
+            }
+
             switch (render_mode) {
                 case 0: {
                     // textured drawing
                     draw_triangle(
                         ctx,
                         ctx->current_shader,
-                        screen0_x, screen0_y, pv0.w, tv0.texcoord.x, tv0.texcoord.y, tv0.color,
-                        screen1_x, screen1_y, pv1.w, tv1.texcoord.x, tv1.texcoord.y, tv1.color,
-                        screen2_x, screen2_y, pv2.w, tv2.texcoord.x, tv2.texcoord.y, tv2.color
+                        screen0_x, screen0_y, screen0_w, tv0.texcoord.x, tv0.texcoord.y, tv0.color,
+                        screen1_x, screen1_y, screen1_w, tv1.texcoord.x, tv1.texcoord.y, tv1.color,
+                        screen2_x, screen2_y, screen2_w, tv2.texcoord.x, tv2.texcoord.y, tv2.color
                     );
                 } break;
                 case 1: {
@@ -454,9 +990,9 @@ void g_draw_elements(render_context *ctx, u32 count, u32 *indices, int render_mo
                     draw_triangle(
                         ctx,
                         SHADER_SFC,
-                        screen0_x, screen0_y, pv0.w, tv0.texcoord.x, tv0.texcoord.y, material_color,
-                        screen1_x, screen1_y, pv1.w, tv1.texcoord.x, tv1.texcoord.y, material_color,
-                        screen2_x, screen2_y, pv2.w, tv2.texcoord.x, tv2.texcoord.y, material_color
+                        screen0_x, screen0_y, screen0_w, tv0.texcoord.x, tv0.texcoord.y, material_color,
+                        screen1_x, screen1_y, screen1_w, tv1.texcoord.x, tv1.texcoord.y, material_color,
+                        screen2_x, screen2_y, screen2_w, tv2.texcoord.x, tv2.texcoord.y, material_color
                     );
                 } break;
                 case 2: {
@@ -465,6 +1001,16 @@ void g_draw_elements(render_context *ctx, u32 count, u32 *indices, int render_mo
                     draw_line(ctx, (int)screen1_x, (int)screen1_y, (int)screen2_x, (int)screen2_y, material_color);
                     draw_line(ctx, (int)screen2_x, (int)screen2_y, (int)screen0_x, (int)screen0_y, material_color);
                 } break;
+                case 4: {
+                    // visibility buffer drawing, shaded once per pixel by g_resolve_visibility
+                    draw_triangle_visibility(
+                        ctx,
+                        ctx->current_shader,
+                        screen0_x, screen0_y, screen0_w, tv0.texcoord.x, tv0.texcoord.y, tv0.color,
+                        screen1_x, screen1_y, screen1_w, tv1.texcoord.x, tv1.texcoord.y, tv1.color,
+                        screen2_x, screen2_y, screen2_w, tv2.texcoord.x, tv2.texcoord.y, tv2.color
+                    );
+                } break;
                 case 3: {
                     // normal drawing
                     vec3 normal_color0 = vec3_scale(vec3_add(tv0.normal, (vec3){1.0f,1.0f,1.0f}), 0.5f);
@@ -473,9 +1019,9 @@ void g_draw_elements(render_context *ctx, u32 count, u32 *indices, int render_mo
                     draw_triangle(
                         ctx,
                         SHADER_SGC,
-                        screen0_x, screen0_y, pv0.w, tv0.texcoord.x, tv0.texcoord.y, pack_color(normal_color0),
-                        screen1_x, screen1_y, pv1.w, tv1.texcoord.x, tv1.texcoord.y, pack_color(normal_color1),
-                        screen2_x, screen2_y, pv2.w, tv2.texcoord.x, tv2.texcoord.y, pack_color(normal_color2)
+                        screen0_x, screen0_y, screen0_w, tv0.texcoord.x, tv0.texcoord.y, pack_color(normal_color0),
+                        screen1_x, screen1_y, screen1_w, tv1.texcoord.x, tv1.texcoord.y, pack_color(normal_color1),
+                        screen2_x, screen2_y, screen2_w, tv2.texcoord.x, tv2.texcoord.y, pack_color(normal_color2)
                     );
                 } break;
             }
@@ -490,35 +1036,125 @@ void draw_triangle(
     float x1, float y1, float w1, float u1, float v1, u32 c1,
     float x2, float y2, float w2, float u2, float v2, u32 c2) {
     
+#ifdef RASTER_SIMD
+    // scalar shaders are promoted to their 8-wide counterpart
+    switch (shader_type) {
+        case SHADER_SGT: shader_type = SHADER_VGT; break;
+        case SHADER_SGC: shader_type = SHADER_VGC; break;
+        case SHADER_SFT: shader_type = SHADER_VFT; break;
+        case SHADER_SFC: shader_type = SHADER_VFC; break;
+        default: break;
+    }
+#endif
+
+    rasterizer_t rasterize = NULL;
     if (ctx->bilinear_sampling) {
         switch (shader_type) {
-            case SHADER_SGT: {
-                draw_triangle_sgtb(ctx, x0, y0, w0, u0, v0, c0, x1, y1, w1, u1, v1, c1, x2, y2, w2, u2, v2, c2);
-            } break;
-            case SHADER_SGC: {
-                draw_triangle_sgcb(ctx, x0, y0, w0, u0, v0, c0, x1, y1, w1, u1, v1, c1, x2, y2, w2, u2, v2, c2);
-            } break;
-            case SHADER_SFT: {
-                draw_triangle_sftb(ctx, x0, y0, w0, u0, v0, c0, x1, y1, w1, u1, v1, c1, x2, y2, w2, u2, v2, c2);
-            } break;
-            case SHADER_SFC: {
-                draw_triangle_sfcb(ctx, x0, y0, w0, u0, v0, c0, x1, y1, w1, u1, v1, c1, x2, y2, w2, u2, v2, c2);
-            } break;
+            case SHADER_SGT: rasterize = draw_triangle_sgtb; break;
+            case SHADER_SGC: rasterize = draw_triangle_sgcb; break;
+            case SHADER_SFT: rasterize = draw_triangle_sftb; break;
+            case SHADER_SFC: rasterize = draw_triangle_sfcb; break;
+#ifdef RASTER_SIMD
+            case SHADER_VGT: rasterize = draw_triangle_vgtb; break;
+            case SHADER_VGC: rasterize = draw_triangle_vgcb; break;
+            case SHADER_VFT: rasterize = draw_triangle_vftb; break;
+            case SHADER_VFC: rasterize = draw_triangle_vfcb; break;
+#else
+            case SHADER_VGT: rasterize = draw_triangle_sgtb; break;
+            case SHADER_VGC: rasterize = draw_triangle_sgcb; break;
+            case SHADER_VFT: rasterize = draw_triangle_sftb; break;
+            case SHADER_VFC: rasterize = draw_triangle_sfcb; break;
+#endif
         }
     } else {
         switch (shader_type) {
-            case SHADER_SGT: {
-                draw_triangle_sgt(ctx, x0, y0, w0, u0, v0, c0, x1, y1, w1, u1, v1, c1, x2, y2, w2, u2, v2, c2);
-            } break;
-            case SHADER_SGC: {
-                draw_triangle_sgc(ctx, x0, y0, w0, u0, v0, c0, x1, y1, w1, u1, v1, c1, x2, y2, w2, u2, v2, c2);
-            } break;
-            case SHADER_SFT: {
-                draw_triangle_sft(ctx, x0, y0, w0, u0, v0, c0, x1, y1, w1, u1, v1, c1, x2, y2, w2, u2, v2, c2);
-            } break;
-            case SHADER_SFC: {
-                draw_triangle_sfc(ctx, x0, y0, w0, u0, v0, c0, x1, y1, w1, u1, v1, c1, x2, y2, w2, u2, v2, c2);
-            } break;
+            case SHADER_SGT: rasterize = draw_triangle_sgt; break;
+            case SHADER_SGC: rasterize = draw_triangle_sgc; break;
+            case SHADER_SFT: rasterize = draw_triangle_sft; break;
+            case SHADER_SFC: rasterize = draw_triangle_sfc; break;
+#ifdef RASTER_SIMD
+            case SHADER_VGT: rasterize = draw_triangle_vgt; break;
+            case SHADER_VGC: rasterize = draw_triangle_vgc; break;
+            case SHADER_VFT: rasterize = draw_triangle_vft; break;
+            case SHADER_VFC: rasterize = draw_triangle_vfc; break;
+#else
+            case SHADER_VGT: rasterize = draw_triangle_sgt; break;
+            case SHADER_VGC: rasterize = draw_triangle_sgc; break;
+            case SHADER_VFT: rasterize = draw_triangle_sft; break;
+            case SHADER_VFC: rasterize = draw_triangle_sfc; break;
+#endif
         }
     }
+    if (!rasterize) return;
+
+    texture_t* texture = m_get_texture(ctx->material_manager, ctx->material_id);
+
+    if (ctx->tiles) {
+        raster_triangle_t tri = {
+            .rasterize = rasterize,
+            .texture = texture,
+            .v = {
+                { x0, y0, w0, u0, v0, c0 },
+                { x1, y1, w1, u1, v1, c1 },
+                { x2, y2, w2, u2, v2, c2 },
+            }
+        };
+        tiles_bin_triangle(ctx->tiles, &ctx->framebuffer, &tri);
+        return;
+    }
+
+    const raster_rect_t screen = { 0, 0, ctx->framebuffer.width - 1, ctx->framebuffer.height - 1 };
+    rasterize(ctx, texture, &screen, x0, y0, w0, u0, v0, c0, x1, y1, w1, u1, v1, c1, x2, y2, w2, u2, v2, c2);
+}
+
+// records the triangle for g_resolve_visibility and rasterizes only its depth
+// and id, texture lookups are left to the resolve except for alpha testing
+static void draw_triangle_visibility(
+    render_context* ctx,
+    shader_type_t shader_type,
+    float x0, float y0, float w0, float u0, float v0, u32 c0,
+    float x1, float y1, float w1, float u1, float v1, u32 c1,
+    float x2, float y2, float w2, float u2, float v2, u32 c2) {
+
+    bool textured = (shader_type == SHADER_SGT || shader_type == SHADER_SFT ||
+                     shader_type == SHADER_VGT || shader_type == SHADER_VFT);
+    texture_t* texture = textured ? m_get_texture(ctx->material_manager, ctx->material_id) : NULL;
+    if (textured && !texture) return; // the textured rasterizers draw nothing without a texture either
+
+    const raster_vertex_t v[3] = {
+        { x0, y0, w0, u0, v0, c0 },
+        { x1, y1, w1, u1, v1, c1 },
+        { x2, y2, w2, u2, v2, c2 },
+    };
+    u32 id = visibility_add_triangle(ctx, shader_type, texture, v);
+    if (id == 0) return;
+
+    texture_t* alpha_texture = (texture && texture->alpha_tested) ? texture : NULL;
+    rasterizer_t rasterize;
+#ifdef RASTER_SIMD
+    if (!alpha_texture)               rasterize = draw_triangle_vid;
+    else if (ctx->bilinear_sampling)  rasterize = draw_triangle_vidtb;
+    else                              rasterize = draw_triangle_vidt;
+#else
+    if (!alpha_texture)               rasterize = draw_triangle_sid;
+    else if (ctx->bilinear_sampling)  rasterize = draw_triangle_sidtb;
+    else                              rasterize = draw_triangle_sidt;
+#endif
+
+    if (ctx->tiles) {
+        raster_triangle_t tri = {
+            .rasterize = rasterize,
+            .texture = alpha_texture,
+            .v = {
+                { x0, y0, w0, u0, v0, id },
+                { x1, y1, w1, u1, v1, id },
+                { x2, y2, w2, u2, v2, id },
+            }
+        };
+        tiles_bin_triangle(ctx->tiles, &ctx->framebuffer, &tri);
+        return;
+    }
+
+    const raster_rect_t screen = { 0, 0, ctx->framebuffer.width - 1, ctx->framebuffer.height - 1 };
+    rasterize(ctx, alpha_texture, &screen, x0, y0, w0, u0, v0, id, x1, y1, w1, u1, v1, id, x2, y2, w2, u2, v2, id);
 }
@@ -9,7 +9,8 @@
 
 enum {
   GBUFFER_INDEX,
-  GBUFFER_VERTEX
+  GBUFFER_VERTEX,
+  GBUFFER_VERTEX_STREAMS // vertex_streams_t of the bound vertex buffer, optional
 };
 
 typedef struct {
@@ -27,22 +28,68 @@ enum {
     FRUSTUM_FAR
 };
 
+// outcode bits of the guard band planes, in the same order as the side planes
+#define FRUSTUM_GUARD_SHIFT 6
+
 typedef struct {
-    clipping_plane_t planes[6];
+    clipping_plane_t planes[6];       // clip space, fixed by the projection's [-w, w] x [-w, w] x [0, w] volume
+    clipping_plane_t guard_planes[4]; // left, right, top and bottom pushed out to the guard band
 } frustum_t;
 
+// rasterizers classify triangles against screen-aligned blocks of this many
+// pixels per side before testing individual pixels
+#define RASTER_BLOCK_SIZE 8
+
+// relative slack on the hi-z test, so float error in the depth plane can never
+// reject a block that has a pixel passing the per-pixel depth test
+#define RASTER_HIZ_EPSILON 1e-4f
+
 typedef struct {
   u32* color_buffer;
   float* depth_buffer;
   int width, height;
+
+  // hi-z: farthest depth (smallest 1/w) of every RASTER_BLOCK_SIZE block of the
+  // depth buffer, kept up to date by the rasterizers and reset by framebuffer_clear
+  float* hiz_buffer;
+  int hiz_width, hiz_height;
+
+  // visibility buffer: id + 1 of the frontmost triangle of the pending
+  // visibility pass, 0 where nothing was drawn. g_resolve_visibility shades
+  // these pixels and sets them back to 0
+  u32* id_buffer;
+
+  // occlusion culling: depth (1/w) of the occluders drawn since framebuffer_clear
+  // at OCCLUSION_WIDTH x OCCLUSION_HEIGHT over the whole viewport, see occlusion.h
+  float* occlusion_buffer;
+  int occlusion_width, occlusion_height;
 } framebuffer_t;
 
+// vertices are snapped to 1/(1 << RASTER_SUBPIXEL_BITS) of a pixel and the
+// edge functions are evaluated exactly in fixed point from there
+#define RASTER_SUBPIXEL_BITS 8
+
+// triangles within this many pixels of the screen origin are not clipped
+// against the side planes, the rasterizer's bounding box does it instead.
+// fixed point edge functions grow to 2^11 * band^2, so the band must stay
+// below 1024 pixels to fit in i32
+#define RASTER_GUARD_BAND 1000
+
+// inclusive pixel rectangle a rasterizer is allowed to write to
+typedef struct {
+    int min_x, min_y;
+    int max_x, max_y;
+} raster_rect_t;
+
 typedef enum {
     SHADER_SGT, // scalar gouraud textured
     SHADER_SGC, // scalar gouraud colored
     SHADER_SFC, // scalar flat colored
     SHADER_SFT, // scalar flat textured
-    // TODO: simd
+    SHADER_VGT, // simd gouraud textured
+    SHADER_VGC, // simd gouraud colored
+    SHADER_VFC, // simd flat colored
+    SHADER_VFT, // simd flat textured
 } shader_type_t;
 
 enum {
@@ -50,6 +97,28 @@ enum {
     MESH_FLAT
 };
 
+// post-transform vertex cache entry: a vertex of the bound vertex buffer after
+// the world/view transform of the current draw
+typedef struct {
+    vec4 position; // clip space
+    u32 outcode;   // one bit per FRUSTUM_* plane the vertex is outside of, guard planes from FRUSTUM_GUARD_SHIFT
+    u32 stamp;     // draw that filled the entry, stale when != vertex_cache_stamp
+} transformed_vertex_t;
+
+// work g_draw_mesh skipped by culling and level of detail, counted until g_reset_stats
+typedef struct {
+    int meshes_drawn;
+    int meshes_culled;
+    int submeshes_drawn;
+    int submeshes_culled;
+    int meshlets_drawn;
+    int meshlets_culled;
+    int meshlets_occluded;
+    int submeshes_simplified; // drawn at a coarser level of detail
+    int triangles_culled;     // triangles of the culled submeshes and meshlets
+    int triangles_simplified; // triangles the coarser levels of detail left out
+} render_stats_t;
+
 typedef struct render_context {
     mat4 projection_matrix;
     mat4 world_matrix;
@@ -60,6 +129,7 @@ typedef struct render_context {
     framebuffer_t framebuffer;
 
     buffer_t vertex_buffer;
+    buffer_t vertex_streams; // reset whenever a vertex buffer is bound
     buffer_t index_buffer;
     int material_id;
 
@@ -75,13 +145,37 @@ typedef struct render_context {
     bool depth_test;
     bool blend_test;
     bool cull_face;
+    bool guard_band;
+    bool occlusion_culling;
+    float lod_threshold; // pixels a coarser level of detail may be off by, 0 draws full detail only
     bool bilinear_sampling;
+    mipmap_mode_t mipmap_mode;
+
+    int thread_count;
+    struct tile_renderer* tiles; // only used when thread_count > 1
+    struct worker_pool* pool;    // threads of the tiles, also lent to loaders, NULL when thread_count == 1
+
+    struct visibility_triangle* visibility; // dynamic array, triangles of the pending visibility pass
+
+    transformed_vertex_t* vertex_cache; // dynamic array, one entry per vertex of the bound vertex buffer
+    u32 vertex_cache_stamp;
+    u32* vertex_batch;                  // dynamic array, vertices the vertex stage still has to process
+
+    render_stats_t stats;
 } render_context;
 
+typedef void (*rasterizer_t)(
+        render_context* ctx, texture_t* texture, const raster_rect_t* clip,
+        float x0, float y0, float w0, float u0, float v0, u32 c0,
+        float x1, float y1, float w1, float u1, float v1, u32 c1,
+        float x2, float y2, float w2, float u2, float v2, u32 c2);
+
 void draw_pixel(render_context *ctx, int x, int y, u32 c);
 
 framebuffer_t framebuffer_init(int width, int height);
-frustum_t frustum_init(float fov, float aspect_ratio, float clipping_near, float clipping_far);
+void framebuffer_clear(framebuffer_t *fb, u32 color);
+frustum_t frustum_init(void);
+void frustum_set_guard_band(frustum_t* frustum, int width, int height);
 
 render_context render_context_init(
     int width, int height,
@@ -100,6 +194,14 @@ void g_draw_mesh(render_context* ctx, mesh_t* mesh, int type, int render_mode);
 void g_draw_elements(render_context *ctx, u32 count, u32 *indices, int render_mode);
 
 void g_set_bilinear_sampling(render_context *ctx, bool enabled);
+void g_set_guard_band(render_context *ctx, bool enabled);
+void g_set_occlusion_culling(render_context *ctx, bool enabled);
+void g_set_lod_threshold(render_context *ctx, float pixels);
+void g_set_mipmap_mode(render_context *ctx, mipmap_mode_t mode);
+void g_set_thread_count(render_context *ctx, int thread_count);
+void g_flush(render_context *ctx);
+void g_reset_stats(render_context *ctx);
+void g_resolve_visibility(render_context *ctx);
 
 void draw_triangle(
         render_context* ctx,
@@ -73,6 +73,10 @@ void handle_event(int event, void *data) {
                     render_mode = 3;
                     printf("Render mode: Face normals\n");
                     break;
+                case KEY_5:
+                    render_mode = 4;
+                    printf("Render mode: Textured (visibility buffer)\n");
+                    break;
 
                 default: break;
             }
@@ -122,9 +126,16 @@ int main(int argc, char *argv[]) {
         true, false, true
     );
     window_bind_framebuffer(win, &ctx.framebuffer);
+    g_set_thread_count(&ctx, thread_cpu_count());
+    g_set_occlusion_culling(&ctx, true);
+
+    // --texture-cache <dir>: keep processed textures in dir, off by default
+    for (int i = 1; i + 1 < argc; i++) {
+        if (strcmp(argv[i], "--texture-cache") == 0) m_set_texture_cache(ctx.material_manager, argv[++i]);
+    }
 
     mesh_t knight_model = {0};
-    load_obj("assets/models/lighthouse.obj", &knight_model, ctx.material_manager);
+    load_obj("assets/models/lighthouse.obj", &knight_model, ctx.material_manager, ctx.pool);
     knight_model.position = (vec3){0,-1,0};
     knight_model.rotation = (vec3){0,32,0};
     knight_model.scale    = (vec3){10,10,10};
@@ -183,12 +194,14 @@ int main(int argc, char *argv[]) {
         // cam_pos.y = orbit_height;
         // g_update_view_matrix(&ctx, mat4_look_at(cam_pos, orbit_target, vec3_up()));
 
-        for (int i = 0; i < ctx.framebuffer.width * ctx.framebuffer.height; i++) ctx.framebuffer.color_buffer[i] = 0xff6fa29e;
-        memset(ctx.framebuffer.depth_buffer, 0.0f, ctx.framebuffer.width * ctx.framebuffer.height * sizeof(float));
+        framebuffer_clear(&ctx.framebuffer, 0xff6fa29e);
+        g_reset_stats(&ctx);
 
         g_set_bilinear_sampling(&ctx, true);
+        g_set_mipmap_mode(&ctx, MIPMAP_LINEAR);
 
         g_draw_mesh(&ctx, &knight_model, MESH_GOURAUD, render_mode);
+        g_resolve_visibility(&ctx);
 
         window_blit(win);
         frame_count++;
@@ -199,12 +212,16 @@ int main(int argc, char *argv[]) {
             frame_count = 0;
             fps_timer -= 1.0;
 
-            char title[64];
-            snprintf(title, 64, "software renderer - fps: %d", last_fps);
+            char title[128];
+            snprintf(title, 128, "software renderer - fps: %d, culled submeshes: %d/%d, meshlets: %d/%d, occluded: %d", last_fps,
+                     ctx.stats.submeshes_culled, ctx.stats.submeshes_culled + ctx.stats.submeshes_drawn,
+                     ctx.stats.meshlets_culled, ctx.stats.meshlets_culled + ctx.stats.meshlets_occluded + ctx.stats.meshlets_drawn,
+                     ctx.stats.meshlets_occluded);
             window_set_title(win, title);
         }
     }
 
+    g_set_thread_count(&ctx, 1); // joins the raster threads
     m_free(ctx.material_manager);
     window_destroy(win);
     return 0;
@@ -5,6 +5,7 @@
 #include "c3m.h"
 #include "platform.h"
 #include "graphics.h"
+#include "thread.h"
 #include "parser.h"
 #include "vertex.h"
 #include "mesh.h"
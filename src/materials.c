@@ -10,20 +10,33 @@ material_manager_t m_init() {
         m.textures[i].width = 0;
         m.textures[i].height = 0;
         m.textures[i].channels = 0;
+        m.textures[i].format = TEXTURE_RGBA8;
+        m.textures[i].alpha_tested = false;
+        m.textures[i].level_count = 0;
     }
 
     for (int i = 0; i < MAX_MATERIALS; i++) {
         m.material_used[i] = false;
         m.materials[i] = (material_t){0};
     }
+    m.compress_textures = false;
     return m;
 }
 
+// data is either malloc'd or a view of a texture cache file
+static void m_release_texture_data(texture_t* t) {
+    if (t->cache.size > 0) {
+        file_unmap(&t->cache);
+    } else {
+        free(t->data);
+    }
+    t->data = NULL;
+}
+
 void m_free(material_manager_t* m) {
     for (int i = 0; i < MAX_TEXTURES; i++) {
         if (m->texture_used[i] && m->textures[i].data) {
-            free(m->textures[i].data);
-            m->textures[i].data = NULL;
+            m_release_texture_data(&m->textures[i]);
             m->texture_used[i] = false;
         }
     }
@@ -51,13 +64,313 @@ void m_parse_texture_file(const char* filename, int* width, int* height, int* ch
     *data = img;
 }
 
+// sizes of the mip chain halving t's size down to 1x1, with the levels
+// packed row-major one after another. returns the texels of the whole chain
+static int m_mip_chain(texture_t* t) {
+    t->level_count = 1;
+    t->level_width[0] = t->width;
+    t->level_height[0] = t->height;
+    t->level_offset[0] = 0;
+
+    int total = t->width * t->height;
+    while (t->level_count < MAX_TEXTURE_LEVELS) {
+        const int prev = t->level_count - 1;
+        if (t->level_width[prev] == 1 && t->level_height[prev] == 1) break;
+
+        const int level = t->level_count++;
+        t->level_width[level]  = (t->level_width[prev]  > 1) ? t->level_width[prev]  / 2 : 1;
+        t->level_height[level] = (t->level_height[prev] > 1) ? t->level_height[prev] / 2 : 1;
+        t->level_offset[level] = total;
+        total += t->level_width[level] * t->level_height[level];
+    }
+    return total;
+}
+
+// where every level of t starts in the tiled layout, returns the texels of the whole chain
+static int m_tiled_offsets(const texture_t* t, i32 offsets[MAX_TEXTURE_LEVELS]) {
+    int total = 0;
+    for (int level = 0; level < t->level_count; level++) {
+        const int tiles_x = texture_tiles_x(t->level_width[level]);
+        const int tiles_y = texture_tiles_x(t->level_height[level]);
+        offsets[level] = total;
+        total += tiles_x * tiles_y * TEXTURE_TILE_SIZE * TEXTURE_TILE_SIZE;
+    }
+    return total;
+}
+
+// grows data to hold the whole mip chain and fills every level with a 2x2
+// box filter of the one above it, returns the (possibly moved) data
+static unsigned char* m_generate_mipmaps(texture_t* t, unsigned char* data) {
+    if (!data || t->channels != 4) {
+        t->level_count = 1;
+        t->level_width[0] = t->width;
+        t->level_height[0] = t->height;
+        t->level_offset[0] = 0;
+        return data;
+    }
+
+    const int total = m_mip_chain(t);
+
+    unsigned char* chain = realloc(data, (size_t)total * 4);
+    if (!chain) {
+        printf("WARNING: m_generate_mipmaps: out of memory, texture keeps its base level only\n");
+        t->level_count = 1;
+        return data;
+    }
+
+    for (int level = 1; level < t->level_count; level++) {
+        const int src_width = t->level_width[level - 1];
+        const int src_height = t->level_height[level - 1];
+        const unsigned char* src = chain + (size_t)t->level_offset[level - 1] * 4;
+        unsigned char* dst = chain + (size_t)t->level_offset[level] * 4;
+
+        for (int y = 0; y < t->level_height[level]; y++) {
+            const int y0 = y * 2;
+            const int y1 = (y0 + 1 < src_height) ? y0 + 1 : y0;
+            for (int x = 0; x < t->level_width[level]; x++) {
+                const int x0 = x * 2;
+                const int x1 = (x0 + 1 < src_width) ? x0 + 1 : x0;
+                for (int c = 0; c < 4; c++) {
+                    const int sum = src[(y0 * src_width + x0) * 4 + c] + src[(y0 * src_width + x1) * 4 + c] +
+                                    src[(y1 * src_width + x0) * 4 + c] + src[(y1 * src_width + x1) * 4 + c];
+                    dst[(y * t->level_width[level] + x) * 4 + c] = (unsigned char)((sum + 2) / 4);
+                }
+            }
+        }
+    }
+    return chain;
+}
+
+// moves every level of the row-major chain into the tiled layout, returns the
+// new data or NULL (with data freed) when out of memory
+static unsigned char* m_tile_levels(texture_t* t, unsigned char* data) {
+    if (!data || t->channels != 4) return data;
+
+    i32 offsets[MAX_TEXTURE_LEVELS];
+    const int total = m_tiled_offsets(t, offsets);
+
+    u32* tiled = calloc((size_t)total, 4);
+    if (!tiled) {
+        free(data);
+        t->level_count = 0;
+        return NULL;
+    }
+
+    for (int level = 0; level < t->level_count; level++) {
+        const int width = t->level_width[level];
+        const u32* src = (const u32*)data + t->level_offset[level];
+        u32* dst = tiled + offsets[level];
+        for (int y = 0; y < t->level_height[level]; y++) {
+            const int row = texture_tile_row(y, width);
+            for (int x = 0; x < width; x++) {
+                dst[row + texture_tile_column(x)] = src[y * width + x];
+            }
+        }
+        t->level_offset[level] = offsets[level];
+    }
+
+    free(data);
+    return (unsigned char*)tiled;
+}
+
+static u16 m_pack_565(const int c[3]) {
+    return (u16)((((c[0] * 31 + 127) / 255) << 11) | (((c[1] * 63 + 127) / 255) << 5) | ((c[2] * 31 + 127) / 255));
+}
+
+static void m_unpack_565(u16 p, int c[3]) {
+    const int r = (p >> 11) & 31, g = (p >> 5) & 63, b = p & 31;
+    c[0] = (r << 3) | (r >> 2);
+    c[1] = (g << 2) | (g >> 4);
+    c[2] = (b << 3) | (b >> 2);
+}
+
+static void m_write_le(unsigned char* out, u64 value, int bytes) {
+    for (int i = 0; i < bytes; i++) out[i] = (unsigned char)(value >> (i * 8));
+}
+
+// bc1 color block: endpoints on the diagonal of the (slightly inset) bounding
+// box that follows the sign of the covariance, then the closest of 4 colors per texel
+static void m_encode_color_block(const u32 texels[16], unsigned char* out) {
+    int lo[3] = {255, 255, 255}, hi[3] = {0, 0, 0}, mean[3] = {0, 0, 0};
+    for (int i = 0; i < 16; i++) {
+        for (int c = 0; c < 3; c++) {
+            const int v = (texels[i] >> (c * 8)) & 0xFF;
+            if (v < lo[c]) lo[c] = v;
+            if (v > hi[c]) hi[c] = v;
+            mean[c] += v;
+        }
+    }
+
+    int axis = 0;
+    for (int c = 0; c < 3; c++) {
+        mean[c] /= 16;
+        if (hi[c] - lo[c] > hi[axis] - lo[axis]) axis = c;
+        const int inset = (hi[c] - lo[c]) >> 4;
+        lo[c] += inset;
+        hi[c] -= inset;
+    }
+    for (int c = 0; c < 3; c++) {
+        if (c == axis) continue;
+        int covariance = 0;
+        for (int i = 0; i < 16; i++) {
+            covariance += (((texels[i] >> (axis * 8)) & 0xFF) - mean[axis]) * (((texels[i] >> (c * 8)) & 0xFF) - mean[c]);
+        }
+        if (covariance < 0) {
+            const int t = lo[c];
+            lo[c] = hi[c];
+            hi[c] = t;
+        }
+    }
+
+    u16 c0 = m_pack_565(hi), c1 = m_pack_565(lo);
+    if (c0 < c1) {
+        const u16 t = c0;
+        c0 = c1;
+        c1 = t;
+    }
+
+    int palette[4][3];
+    m_unpack_565(c0, palette[0]);
+    m_unpack_565(c1, palette[1]);
+    for (int c = 0; c < 3; c++) {
+        palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+        palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+    }
+
+    u32 indices = 0;
+    if (c0 != c1) {
+        for (int i = 0; i < 16; i++) {
+            int best = 0, best_error = 0x7fffffff;
+            for (int k = 0; k < 4; k++) {
+                int error = 0;
+                for (int c = 0; c < 3; c++) {
+                    const int d = (int)((texels[i] >> (c * 8)) & 0xFF) - palette[k][c];
+                    error += d * d;
+                }
+                if (error < best_error) {
+                    best_error = error;
+                    best = k;
+                }
+            }
+            indices |= (u32)best << (i * 2);
+        }
+    }
+
+    m_write_le(out, c0, 2);
+    m_write_le(out + 2, c1, 2);
+    m_write_le(out + 4, indices, 4);
+}
+
+// bc3 alpha block: max and min alpha as endpoints, then the closest of the 8
+// interpolated values per texel. which texels have alpha 0 is kept exactly
+static void m_encode_alpha_block(const u32 texels[16], unsigned char* out) {
+    int a0 = 0, a1 = 255;
+    for (int i = 0; i < 16; i++) {
+        const int a = texels[i] >> 24;
+        if (a > a0) a0 = a;
+        if (a < a1) a1 = a;
+    }
+
+    int palette[8] = {a0, a1};
+    for (int k = 2; k < 8; k++) palette[k] = ((8 - k) * a0 + (k - 1) * a1) / 7;
+
+    u64 indices = 0;
+    if (a0 != a1) {
+        for (int i = 0; i < 16; i++) {
+            const int a = texels[i] >> 24;
+            int best = 0;
+            for (int k = 1; k < 8; k++) {
+                // a texel the alpha test keeps must not round down to 0
+                if (a != 0 && palette[k] == 0) continue;
+                if (abs(a - palette[k]) < abs(a - palette[best])) best = k;
+            }
+            indices |= (u64)best << (i * 3);
+        }
+    }
+
+    out[0] = (unsigned char)a0;
+    out[1] = (unsigned char)a1;
+    m_write_le(out + 2, indices, 6);
+}
+
+// encodes every tile of the tiled rgba chain as one bc1 block, or bc3 when the
+// texture is alpha tested. returns the new data, or data unchanged when out of memory
+static unsigned char* m_compress_levels(texture_t* t, unsigned char* data) {
+    if (!data || t->channels != 4) return data;
+
+    const texture_format_t format = t->alpha_tested ? TEXTURE_BC3 : TEXTURE_BC1;
+    const int block_size = (format == TEXTURE_BC3) ? 16 : 8;
+    const int last = t->level_count - 1;
+    const int blocks = t->level_offset[last] / 16 + texture_tiles_x(t->level_width[last]) * texture_tiles_x(t->level_height[last]);
+
+    unsigned char* compressed = malloc((size_t)blocks * block_size);
+    if (!compressed) {
+        printf("WARNING: m_compress_levels: out of memory, texture stays uncompressed\n");
+        return data;
+    }
+
+    const u32* texels = (const u32*)data;
+    for (int level = 0; level < t->level_count; level++) {
+        const int width = t->level_width[level];
+        const int height = t->level_height[level];
+        const int tiles_x = texture_tiles_x(width);
+
+        for (int ty = 0; ty < texture_tiles_x(height); ty++) {
+            for (int tx = 0; tx < tiles_x; tx++) {
+                // padding texels of levels smaller than a tile repeat the edge
+                u32 block[16];
+                for (int i = 0; i < 16; i++) {
+                    int x = tx * TEXTURE_TILE_SIZE + (i & TEXTURE_TILE_MASK);
+                    int y = ty * TEXTURE_TILE_SIZE + (i >> TEXTURE_TILE_SHIFT);
+                    if (x >= width)  x = width - 1;
+                    if (y >= height) y = height - 1;
+                    block[i] = texels[t->level_offset[level] + texture_tile_row(y, width) + texture_tile_column(x)];
+                }
+
+                unsigned char* out = compressed + (size_t)(t->level_offset[level] / 16 + ty * tiles_x + tx) * block_size;
+                if (format == TEXTURE_BC3) {
+                    m_encode_alpha_block(block, out);
+                    out += 8;
+                }
+                m_encode_color_block(block, out);
+            }
+        }
+    }
+
+    free(data);
+    t->format = format;
+    return compressed;
+}
+
+void m_set_texture_compression(material_manager_t* m, bool enabled) {
+    m->compress_textures = enabled;
+}
+
 int m_create_texture(material_manager_t* m, int width, int height, int channels, unsigned char* data) {
     for (int i = 0; i < MAX_TEXTURES; i++) {
         if (!m->texture_used[i]) {
             m->textures[i].width = width;
             m->textures[i].height = height;
             m->textures[i].channels = channels;
-            m->textures[i].data = data;
+            m->textures[i].format = TEXTURE_RGBA8;
+            m->textures[i].alpha_tested = false;
+            m->textures[i].cache = (mapped_file_t){0};
+            if (data && channels == 4) {
+                for (int t = 0; t < width * height; t++) {
+                    if (data[t * 4 + 3] == 0x00) {
+                        m->textures[i].alpha_tested = true;
+                        break;
+                    }
+                }
+            }
+            m->textures[i].data = m_tile_levels(&m->textures[i], m_generate_mipmaps(&m->textures[i], data));
+            if (data && !m->textures[i].data) {
+                printf("WARNING: m_create_texture: out of memory, could not tile texture.\n");
+                return -1;
+            }
+            if (m->compress_textures) {
+                m->textures[i].data = m_compress_levels(&m->textures[i], m->textures[i].data);
+            }
             m->texture_used[i] = true;
             return i;
         }
@@ -70,13 +383,199 @@ int m_create_texture(material_manager_t* m, int width, int height, int channels,
 void m_delete_texture(material_manager_t* m, int id) {
     if (id >= 0 && id < MAX_TEXTURES && m->texture_used[id]) {
         if (m->textures[id].data) {
-            free(m->textures[id].data);
-            m->textures[id].data = NULL;
+            m_release_texture_data(&m->textures[id]);
         }
         m->texture_used[id] = false;
     }
 }
 
+void m_set_texture_cache(material_manager_t* m, const char* directory) {
+    m->texture_cache[0] = '\0';
+    if (directory) {
+        strncpy(m->texture_cache, directory, sizeof(m->texture_cache) - 1);
+        m->texture_cache[sizeof(m->texture_cache) - 1] = '\0';
+    }
+}
+
+#define TEXTURE_CACHE_MAGIC 0x58455443u // "CTEX"
+#define TEXTURE_CACHE_VERSION 1
+
+// the texture_t fields that describe data, and what they were made from. a
+// cache is only used when the source file and the compression setting match
+typedef struct {
+    u32 magic;
+    u32 version;
+    u64 source_size;
+    i64 source_mtime;
+    u64 source_hash;
+    i32 compressed;
+    i32 width, height;
+    i32 channels;
+    i32 format;
+    i32 alpha_tested;
+    i32 level_count;
+    i32 level_width[MAX_TEXTURE_LEVELS];
+    i32 level_height[MAX_TEXTURE_LEVELS];
+    i32 level_offset[MAX_TEXTURE_LEVELS];
+    u64 data_size;
+} texture_cache_header_t;
+
+// data follows the header from the next cache line on
+#define TEXTURE_CACHE_DATA_OFFSET ((sizeof(texture_cache_header_t) + 63) & ~(size_t)63)
+
+// bytes of the tiled chain in the texture's format, 0 when it is not one
+static u64 m_texture_data_size(const texture_t* t) {
+    if (t->channels != 4 || t->level_count < 1 || t->level_count > MAX_TEXTURE_LEVELS) return 0;
+    const int last = t->level_count - 1;
+    const u64 texels = (u64)t->level_offset[last] +
+                       (u64)texture_tiles_x(t->level_width[last]) * texture_tiles_x(t->level_height[last]) * 16;
+    switch (t->format) {
+        case TEXTURE_RGBA8: return texels * 4;
+        case TEXTURE_BC1:   return texels / 16 * 8;
+        case TEXTURE_BC3:   return texels / 16 * 16;
+    }
+    return 0;
+}
+
+// the cache file of an image: its name, then a hash of the whole path so
+// equally named images in different directories do not collide
+static void m_texture_cache_path(const material_manager_t* m, const char* path, char* out, size_t size) {
+    const char* name = path;
+    for (const char* c = path; *c; c++) {
+        if (*c == '/' || *c == '\\') name = c + 1;
+    }
+    snprintf(out, size, "%s/%s-%016llx.texcache", m->texture_cache, name,
+             (unsigned long long)file_hash(path, strlen(path)));
+}
+
+// maps a cache that matches key's source fields into a free texture slot. the
+// texture is described by a level table rebuilt from the source size the way
+// m_create_texture builds it, and the cache must agree with it field by field
+static int m_adopt_cached_texture(material_manager_t* m, const char* cache_path, const texture_cache_header_t* key) {
+    mapped_file_t file;
+    if (!file_map(cache_path, &file)) return -1;
+
+    const texture_cache_header_t* header = (const texture_cache_header_t*)file.data;
+    texture_t t = {0};
+    bool valid = file.size >= TEXTURE_CACHE_DATA_OFFSET && header->magic == TEXTURE_CACHE_MAGIC && header->version == TEXTURE_CACHE_VERSION &&
+                 header->source_size == key->source_size && header->source_mtime == key->source_mtime &&
+                 header->source_hash == key->source_hash && header->compressed == key->compressed &&
+                 header->width == key->width && header->height == key->height && header->channels == 4;
+    if (valid) {
+        t.width = key->width;
+        t.height = key->height;
+        t.channels = 4;
+        t.alpha_tested = header->alpha_tested != 0;
+        t.format = !key->compressed ? TEXTURE_RGBA8 : t.alpha_tested ? TEXTURE_BC3 : TEXTURE_BC1;
+        m_mip_chain(&t);
+        m_tiled_offsets(&t, t.level_offset);
+
+        valid = header->format == (i32)t.format && header->level_count == t.level_count;
+        for (int level = 0; valid && level < t.level_count; level++) {
+            valid = header->level_width[level] == t.level_width[level] &&
+                    header->level_height[level] == t.level_height[level] &&
+                    header->level_offset[level] == t.level_offset[level];
+        }
+        const u64 size = m_texture_data_size(&t);
+        valid = valid && size > 0 && size == header->data_size && size <= file.size - TEXTURE_CACHE_DATA_OFFSET;
+    }
+
+    int id = -1;
+    for (int i = 0; valid && i < MAX_TEXTURES; i++) {
+        if (!m->texture_used[i]) {
+            id = i;
+            break;
+        }
+    }
+    if (id == -1) {
+        file_unmap(&file);
+        return -1;
+    }
+
+    t.data = (unsigned char*)file.data + TEXTURE_CACHE_DATA_OFFSET;
+    t.cache = file;
+    m->textures[id] = t;
+    m->texture_used[id] = true;
+    return id;
+}
+
+static bool m_write_cached_texture(const char* cache_path, const texture_t* t, texture_cache_header_t header) {
+    header.width = t->width;
+    header.height = t->height;
+    header.channels = t->channels;
+    header.format = t->format;
+    header.alpha_tested = t->alpha_tested;
+    header.level_count = t->level_count;
+    memcpy(header.level_width, t->level_width, sizeof(header.level_width));
+    memcpy(header.level_height, t->level_height, sizeof(header.level_height));
+    memcpy(header.level_offset, t->level_offset, sizeof(header.level_offset));
+    header.data_size = m_texture_data_size(t);
+    if (header.data_size == 0) return false;
+
+    // written under a temporary name and renamed, so no reader maps half a texture
+    char temp_path[600];
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", cache_path);
+    FILE* file = fopen(temp_path, "wb");
+    if (!file) return false;
+
+    unsigned char block[TEXTURE_CACHE_DATA_OFFSET];
+    memset(block, 0, sizeof(block));
+    memcpy(block, &header, sizeof(header));
+    bool ok = fwrite(block, 1, sizeof(block), file) == sizeof(block) &&
+              fwrite(t->data, 1, header.data_size, file) == header.data_size;
+    ok = (fclose(file) == 0) && ok;
+    ok = ok && file_replace(temp_path, cache_path);
+    if (!ok) remove(temp_path);
+    return ok;
+}
+
+int m_load_texture(material_manager_t* m, const char* path) {
+    mapped_file_t source;
+    if (m->texture_cache[0] == '\0' || !file_map(path, &source)) {
+        int width, height, channels;
+        unsigned char* data = NULL;
+        m_parse_texture_file(path, &width, &height, &channels, &data);
+        return data ? m_create_texture(m, width, height, channels, data) : -1;
+    }
+
+    texture_cache_header_t key = {
+        .magic = TEXTURE_CACHE_MAGIC,
+        .version = TEXTURE_CACHE_VERSION,
+        .source_hash = file_hash(source.data, source.size),
+        .compressed = m->compress_textures,
+        .channels = 4,
+    };
+    file_stat(path, &key.source_size, &key.source_mtime);
+
+    // the size from the image header only, the pixels are not decoded for a cache hit
+    char cache_path[512];
+    m_texture_cache_path(m, path, cache_path, sizeof(cache_path));
+    int source_channels;
+    int id = -1;
+    if (stbi_info_from_memory((const unsigned char*)source.data, (int)source.size, &key.width, &key.height, &source_channels)) {
+        id = m_adopt_cached_texture(m, cache_path, &key);
+    }
+    if (id != -1) {
+        file_unmap(&source);
+        return id;
+    }
+
+    // decoded from the mapping, so the file is only read once
+    int width, height, channels;
+    unsigned char* data = stbi_load_from_memory((const unsigned char*)source.data, (int)source.size, &width, &height, &channels, 4);
+    file_unmap(&source);
+    if (!data) {
+        fprintf(stderr, "ERROR: failed to load texture '%s': %s\n", path, stbi_failure_reason());
+        return -1;
+    }
+
+    id = m_create_texture(m, width, height, 4, data);
+    if (id != -1 && !(file_make_directory(m->texture_cache) && m_write_cached_texture(cache_path, &m->textures[id], key))) {
+        printf("WARNING: m_load_texture: could not write texture cache %s\n", cache_path);
+    }
+    return id;
+}
+
 texture_t* m_get_texture(material_manager_t* m, int id) {
     if (id >= 0 && id < MAX_TEXTURES && m->texture_used[id]) {
         return &m->textures[id];
@@ -2,18 +2,69 @@
 #define MATERIALS_H
 
 #include "c3m.h"
+#include "file.h"
 #include <string.h>
 #include <stdio.h>
 
 #define MAX_TEXTURES 128
 #define MAX_MATERIALS 128
+#define MAX_TEXTURE_LEVELS 16
+
+// texels are stored in 4x4 tiles (64 bytes, one cache line), tiles row-major
+// within a level, so a bilinear footprint touches the same lines whatever the
+// uv orientation. levels are padded to whole tiles
+#define TEXTURE_TILE_SHIFT 2
+#define TEXTURE_TILE_SIZE (1 << TEXTURE_TILE_SHIFT)
+#define TEXTURE_TILE_MASK (TEXTURE_TILE_SIZE - 1)
+
+typedef enum {
+    MIPMAP_NONE,    // always sample the base level
+    MIPMAP_NEAREST, // sample the level closest to the pixel's footprint
+    MIPMAP_LINEAR,  // blend the two closest levels (trilinear with bilinear sampling)
+} mipmap_mode_t;
+
+// storage of texture_t.data. the block formats encode one 4x4 tile per block,
+// endpoints are rgb565 and palettes are always the 4 color / 8 alpha variants
+typedef enum {
+    TEXTURE_RGBA8, // 4 bytes per texel
+    TEXTURE_BC1,   // 8 bytes per tile: 2 endpoints, 2 bit indices, opaque
+    TEXTURE_BC3,   // 16 bytes per tile: 8 byte alpha block, then a bc1 color block
+} texture_format_t;
 
 typedef struct {
   int width, height;
   int channels;
-  unsigned char* data;
+  texture_format_t format;
+  unsigned char* data; // base level, followed by the rest of the mip chain
+  bool alpha_tested;   // has fully transparent texels, which the rasterizers discard
+
+  // mip chain down to 1x1, level 0 is width x height at data. offsets are in
+  // texels from data, the arrays are i32 so simd code can gather from them.
+  // texel (x, y) of a level is at level_offset + texture_tile_row(y, w) + texture_tile_column(x),
+  // in the block formats that index / 16 is the block and index % 16 the texel in it
+  int level_count;
+  i32 level_width[MAX_TEXTURE_LEVELS];
+  i32 level_height[MAX_TEXTURE_LEVELS];
+  i32 level_offset[MAX_TEXTURE_LEVELS];
+
+  mapped_file_t cache; // texture cache file data points into, when it came from one
 } texture_t;
 
+static inline int texture_tiles_x(int level_width) {
+    return (level_width + TEXTURE_TILE_MASK) >> TEXTURE_TILE_SHIFT;
+}
+
+// the tiled address splits into a part that only depends on y and one that only
+// depends on x, so the two rows and two columns of a bilinear fetch are computed once
+static inline int texture_tile_row(int y, int level_width) {
+    return (((y >> TEXTURE_TILE_SHIFT) * texture_tiles_x(level_width)) << (2 * TEXTURE_TILE_SHIFT)) +
+           ((y & TEXTURE_TILE_MASK) << TEXTURE_TILE_SHIFT);
+}
+
+static inline int texture_tile_column(int x) {
+    return ((x >> TEXTURE_TILE_SHIFT) << (2 * TEXTURE_TILE_SHIFT)) + (x & TEXTURE_TILE_MASK);
+}
+
 typedef struct {
     char name[128];
     vec3 ambient;       // Ka
@@ -31,13 +82,24 @@ typedef struct {
 
   material_t materials[MAX_MATERIALS];
   bool material_used[MAX_MATERIALS];
+
+  bool compress_textures; // textures created from now on are stored as bc1/bc3
+  char texture_cache[256]; // directory of m_load_texture's cache, empty for none
 } material_manager_t;
 
 material_manager_t m_init();
 void m_free(material_manager_t* m);
 
 void m_parse_texture_file(const char* filename, int* width, int* height, int* channels, unsigned char** data);
+void m_set_texture_compression(material_manager_t* m, bool enabled);
+// directory where m_load_texture keeps textures in their final form (tiled,
+// mipmapped and compressed as configured), created when needed. NULL turns it off
+void m_set_texture_cache(material_manager_t* m, const char* directory);
 int m_create_texture(material_manager_t* m, int width, int height, int channels, unsigned char* data);
+// decodes the image file into a new texture, as m_parse_texture_file then
+// m_create_texture. with a texture cache set, a cached copy is mapped and used
+// in place instead, and a texture that had to be decoded is added to the cache
+int m_load_texture(material_manager_t* m, const char* path);
 void m_delete_texture(material_manager_t* m, int id);
 texture_t* m_get_texture(material_manager_t* m, int id);
 
@@ -1 +1,722 @@
 #include "mesh.h"
+#include "array.h"
+#include <float.h>
+#include <stdio.h>
+#include <string.h>
+
+// (re)builds the vertex streams from mesh->vertices, false when out of memory
+bool mesh_build_streams(mesh_t* mesh) {
+    mesh_free_streams(mesh);
+    if (mesh->vertex_count == 0) return true;
+
+    const int padded = (mesh->vertex_count + 7) & ~7;
+    float* block = _mm_malloc(sizeof(float) * padded * 8, 32);
+    if (!block) {
+        printf("WARNING: mesh_build_streams: out of memory, mesh keeps its vertices only\n");
+        return false;
+    }
+    memset(block, 0, sizeof(float) * padded * 8);
+
+    vertex_streams_t* s = &mesh->streams;
+    s->x  = block;
+    s->y  = block + padded;
+    s->z  = block + padded * 2;
+    s->nx = block + padded * 3;
+    s->ny = block + padded * 4;
+    s->nz = block + padded * 5;
+    s->u  = block + padded * 6;
+    s->v  = block + padded * 7;
+    s->count = mesh->vertex_count;
+
+    for (int i = 0; i < mesh->vertex_count; i++) {
+        const vertex_t* v = &mesh->vertices[i];
+        s->x[i]  = v->position.x;
+        s->y[i]  = v->position.y;
+        s->z[i]  = v->position.z;
+        s->nx[i] = v->normal.x;
+        s->ny[i] = v->normal.y;
+        s->nz[i] = v->normal.z;
+        s->u[i]  = v->texcoord.x;
+        s->v[i]  = v->texcoord.y;
+    }
+    return true;
+}
+
+void mesh_free_streams(mesh_t* mesh) {
+    if (mesh->streams.x) _mm_free(mesh->streams.x);
+    mesh->streams = (vertex_streams_t){0};
+}
+
+static bounds_t bounds_empty(void) {
+    bounds_t b;
+    b.min = vec3_new(INFINITY, INFINITY, INFINITY);
+    b.max = vec3_new(-INFINITY, -INFINITY, -INFINITY);
+    b.center = vec3_zero();
+    b.radius = 0.0f;
+    return b;
+}
+
+static void bounds_add(bounds_t* b, vec3 p) {
+    b->min = vec3_new(fminf(b->min.x, p.x), fminf(b->min.y, p.y), fminf(b->min.z, p.z));
+    b->max = vec3_new(fmaxf(b->max.x, p.x), fmaxf(b->max.y, p.y), fmaxf(b->max.z, p.z));
+}
+
+// the sphere is centered on the box and just reaches the farthest vertex,
+// which is tighter than half the box diagonal
+static void bounds_finish(bounds_t* b, const vertex_t* vertices, const u32* indices, int count) {
+    if (b->min.x > b->max.x) {
+        *b = (bounds_t){0};
+        return;
+    }
+    b->center = vec3_scale(vec3_add(b->min, b->max), 0.5f);
+    float radius_sq = 0.0f;
+    for (int i = 0; i < count; i++) {
+        const vec3 d = vec3_sub(vertices[indices ? indices[i] : (u32)i].position, b->center);
+        radius_sq = fmaxf(radius_sq, vec3_dot(d, d));
+    }
+    b->radius = sqrtf(radius_sq);
+}
+
+void mesh_compute_bounds(mesh_t* mesh) {
+    for (int s = 0; s < mesh->submesh_count; s++) {
+        submesh_t* sub = &mesh->submeshes[s];
+        sub->bounds = bounds_empty();
+        for (int i = 0; i < sub->index_count; i++) bounds_add(&sub->bounds, mesh->vertices[sub->indices[i]].position);
+        bounds_finish(&sub->bounds, mesh->vertices, sub->indices, sub->index_count);
+    }
+
+    mesh->bounds = bounds_empty();
+    for (int i = 0; i < mesh->vertex_count; i++) bounds_add(&mesh->bounds, mesh->vertices[i].position);
+    bounds_finish(&mesh->bounds, mesh->vertices, NULL, mesh->vertex_count);
+}
+
+// sphere around the meshlet's box, and the normal cone of its faces as in
+// meshoptimizer's cluster bounds
+static void meshlet_finish(meshlet_t* ml, const vertex_t* vertices, const u32* indices) {
+    bounds_t b = bounds_empty();
+    for (u32 i = 0; i < ml->index_count; i++) bounds_add(&b, vertices[indices[i]].position);
+    bounds_finish(&b, vertices, indices, ml->index_count);
+    ml->bounds = b;
+
+    vec3 axis = vec3_zero();
+    for (u32 i = 0; i < ml->index_count; i += 3) {
+        const vec3 p0 = vertices[indices[i + 0]].position;
+        const vec3 p1 = vertices[indices[i + 1]].position;
+        const vec3 p2 = vertices[indices[i + 2]].position;
+        const vec3 n = vec3_cross(vec3_sub(p1, p0), vec3_sub(p2, p0));
+        if (vec3_dot(n, n) > 0.0f) axis = vec3_add(axis, vec3_normalize(n));
+    }
+
+    ml->cone_apex = ml->bounds.center;
+    ml->cone_axis = vec3_zero();
+    ml->cone_cutoff = 2.0f;
+    if (vec3_dot(axis, axis) == 0.0f) return;
+    axis = vec3_normalize(axis);
+
+    float min_dot = 1.0f;
+    for (u32 i = 0; i < ml->index_count; i += 3) {
+        const vec3 p0 = vertices[indices[i + 0]].position;
+        const vec3 n = vec3_cross(vec3_sub(vertices[indices[i + 1]].position, p0), vec3_sub(vertices[indices[i + 2]].position, p0));
+        if (vec3_dot(n, n) > 0.0f) min_dot = fminf(min_dot, vec3_dot(axis, vec3_normalize(n)));
+    }
+    if (min_dot <= 0.1f) return; // wider than ~84 degrees, the test would hardly ever pass
+
+    // the apex goes behind every face plane along the axis, so any view from
+    // inside the cone sees the back of every face
+    float apex_distance = 0.0f;
+    for (u32 i = 0; i < ml->index_count; i += 3) {
+        const vec3 p0 = vertices[indices[i + 0]].position;
+        vec3 n = vec3_cross(vec3_sub(vertices[indices[i + 1]].position, p0), vec3_sub(vertices[indices[i + 2]].position, p0));
+        if (vec3_dot(n, n) == 0.0f) continue;
+        n = vec3_normalize(n);
+        const float t = vec3_dot(vec3_sub(ml->bounds.center, p0), n) / vec3_dot(axis, n);
+        apex_distance = fmaxf(apex_distance, t);
+    }
+    ml->cone_apex = vec3_sub(ml->bounds.center, vec3_scale(axis, apex_distance));
+    ml->cone_axis = axis;
+    ml->cone_cutoff = sqrtf(1.0f - min_dot * min_dot);
+}
+
+#define MESHLET_CONE_SPLIT 0.5f
+
+void mesh_build_meshlets(mesh_t* mesh) {
+    int* owner = malloc(sizeof(int) * mesh->vertex_count); // last meshlet that used the vertex
+    if (!owner && mesh->vertex_count > 0) {
+        printf("WARNING: mesh_build_meshlets: out of memory, submeshes are drawn whole\n");
+        return;
+    }
+
+    int meshlet_id = 0;
+    for (int s = 0; s < mesh->submesh_count; s++) {
+        submesh_t* sub = &mesh->submeshes[s];
+        array_free(sub->meshlets);
+        sub->meshlets = NULL;
+        sub->meshlet_count = 0;
+        for (int v = 0; v < mesh->vertex_count; v++) owner[v] = -1;
+
+        meshlet_t ml = { 0 };
+        int vertex_count = 0;
+        vec3 normal_sum = vec3_zero();
+        for (int i = 0; i + 2 < sub->index_count; i += 3) {
+            int new_vertices = 0;
+            for (int k = 0; k < 3; k++) new_vertices += (owner[sub->indices[i + k]] != meshlet_id);
+
+            const vec3 p0 = mesh->vertices[sub->indices[i]].position;
+            vec3 n = vec3_cross(vec3_sub(mesh->vertices[sub->indices[i + 1]].position, p0), vec3_sub(mesh->vertices[sub->indices[i + 2]].position, p0));
+            if (vec3_dot(n, n) > 0.0f) n = vec3_normalize(n);
+
+            // a face turned too far from the others would widen the normal cone past use
+            const bool spread = vec3_dot(n, n) > 0.0f && vec3_dot(n, normal_sum) < MESHLET_CONE_SPLIT * vec3_len(normal_sum);
+            if (vertex_count + new_vertices > MESHLET_MAX_VERTICES || ml.index_count == MESHLET_MAX_TRIANGLES * 3 || spread) {
+                meshlet_finish(&ml, mesh->vertices, sub->indices + ml.index_offset);
+                array_push(sub->meshlets, ml);
+                ml = (meshlet_t){ .index_offset = i };
+                vertex_count = 0;
+                normal_sum = vec3_zero();
+                meshlet_id++;
+            }
+            for (int k = 0; k < 3; k++) {
+                const u32 v = sub->indices[i + k];
+                if (owner[v] != meshlet_id) {
+                    owner[v] = meshlet_id;
+                    vertex_count++;
+                }
+            }
+            normal_sum = vec3_add(normal_sum, n);
+            ml.index_count += 3;
+        }
+        if (ml.index_count > 0) {
+            meshlet_finish(&ml, mesh->vertices, sub->indices + ml.index_offset);
+            array_push(sub->meshlets, ml);
+        }
+        meshlet_id++;
+        sub->meshlet_count = array_length(sub->meshlets);
+    }
+    free(owner);
+}
+
+// tipsify (sander et al. 2007): emits all triangles around one vertex at a time
+// and picks the next fanning vertex among the ones just emitted, preferring
+// whichever will still be in the cache once its remaining triangles are drawn
+static bool tipsify(u32* indices, int index_count, int vertex_count) {
+    const int triangle_count = index_count / 3;
+    if (triangle_count == 0) return true;
+
+    int* offsets   = calloc(vertex_count + 1, sizeof(int));
+    int* adjacency = malloc(sizeof(int) * triangle_count * 3);
+    int* live      = calloc(vertex_count, sizeof(int)); // triangles left per vertex
+    int* stamps    = calloc(vertex_count, sizeof(int)); // time the vertex entered the cache
+    u32* dead_end  = malloc(sizeof(u32) * triangle_count * 3);
+    u8*  emitted   = calloc(triangle_count, 1);
+    u32* out       = malloc(sizeof(u32) * triangle_count * 3);
+
+    const bool ok = offsets && adjacency && live && stamps && dead_end && emitted && out;
+    if (ok) {
+        for (int i = 0; i < triangle_count * 3; i++) live[indices[i]]++;
+        for (int v = 0; v < vertex_count; v++) offsets[v + 1] = offsets[v] + live[v];
+        for (int i = 0; i < triangle_count * 3; i++) {
+            const u32 v = indices[i];
+            adjacency[offsets[v] + stamps[v]++] = i / 3;
+        }
+        memset(stamps, 0, sizeof(int) * vertex_count);
+
+        int time = MESH_CACHE_SIZE + 1;
+        int dead_count = 0, out_count = 0, cursor = 0;
+        int fan = indices[0];
+        while (fan >= 0) {
+            const int fan_start = out_count;
+            for (int a = offsets[fan]; a < offsets[fan + 1]; a++) {
+                const int t = adjacency[a];
+                if (emitted[t]) continue;
+                emitted[t] = 1;
+                for (int k = 0; k < 3; k++) {
+                    const u32 v = indices[t * 3 + k];
+                    out[out_count++] = v;
+                    dead_end[dead_count++] = v;
+                    live[v]--;
+                    if (time - stamps[v] > MESH_CACHE_SIZE) stamps[v] = time++;
+                }
+            }
+
+            fan = -1;
+            int best = -1;
+            for (int c = fan_start; c < out_count; c++) {
+                const u32 v = out[c];
+                if (live[v] <= 0) continue;
+                const int age = time - stamps[v];
+                const int priority = (age + 2 * live[v] <= MESH_CACHE_SIZE) ? age : 0;
+                if (priority > best) {
+                    best = priority;
+                    fan = v;
+                }
+            }
+
+            // dead end: latest vertex with triangles left, else the next one in index order
+            while (fan < 0 && dead_count > 0) {
+                const u32 v = dead_end[--dead_count];
+                if (live[v] > 0) fan = v;
+            }
+            while (fan < 0 && cursor < vertex_count) {
+                if (live[cursor] > 0) fan = cursor;
+                cursor++;
+            }
+        }
+        memcpy(indices, out, sizeof(u32) * triangle_count * 3);
+    }
+
+    free(offsets);
+    free(adjacency);
+    free(live);
+    free(stamps);
+    free(dead_end);
+    free(emitted);
+    free(out);
+    return ok;
+}
+
+// renumbers the vertices in the order the submeshes first use them,
+// vertices no triangle references keep their relative order at the end
+static bool reorder_vertices(mesh_t* mesh) {
+    u32* remap = malloc(sizeof(u32) * mesh->vertex_count);
+    vertex_t* reordered = malloc(sizeof(vertex_t) * mesh->vertex_count);
+    if (!remap || !reordered) {
+        free(remap);
+        free(reordered);
+        return false;
+    }
+    memset(remap, 0xff, sizeof(u32) * mesh->vertex_count);
+
+    u32 next = 0;
+    for (int s = 0; s < mesh->submesh_count; s++) {
+        submesh_t* sub = &mesh->submeshes[s];
+        for (int i = 0; i < sub->index_count; i++) {
+            const u32 v = sub->indices[i];
+            if (remap[v] == UINT32_MAX) {
+                remap[v] = next;
+                reordered[next++] = mesh->vertices[v];
+            }
+            sub->indices[i] = remap[v];
+        }
+    }
+    for (int v = 0; v < mesh->vertex_count; v++) {
+        if (remap[v] == UINT32_MAX) reordered[next++] = mesh->vertices[v];
+    }
+
+    memcpy(mesh->vertices, reordered, sizeof(vertex_t) * mesh->vertex_count);
+    free(remap);
+    free(reordered);
+    return true;
+}
+
+bool mesh_optimize(mesh_t* mesh) {
+    for (int s = 0; s < mesh->submesh_count; s++) {
+        const submesh_t* sub = &mesh->submeshes[s];
+        if (!tipsify(sub->indices, sub->index_count, mesh->vertex_count)) {
+            printf("WARNING: mesh_optimize: out of memory, submesh %d keeps its triangle order\n", s);
+            return false;
+        }
+    }
+    if (!reorder_vertices(mesh)) {
+        printf("WARNING: mesh_optimize: out of memory, vertices keep their order\n");
+        return false;
+    }
+
+    if (mesh->streams.x) return mesh_build_streams(mesh); // streams follow the new vertex order
+    return true;
+}
+
+float mesh_acmr(const mesh_t* mesh) {
+    int misses = 0, triangles = 0;
+    for (int s = 0; s < mesh->submesh_count; s++) {
+        const submesh_t* sub = &mesh->submeshes[s];
+        u32 fifo[MESH_CACHE_SIZE];
+        int fifo_count = 0, fifo_next = 0;
+
+        for (int i = 0; i < sub->index_count; i++) {
+            const u32 v = sub->indices[i];
+            bool hit = false;
+            for (int c = 0; c < fifo_count && !hit; c++) hit = (fifo[c] == v);
+            if (hit) continue;
+
+            misses++;
+            fifo[fifo_next] = v;
+            fifo_next = (fifo_next + 1) % MESH_CACHE_SIZE;
+            if (fifo_count < MESH_CACHE_SIZE) fifo_count++;
+        }
+        triangles += sub->index_count / 3;
+    }
+    return triangles ? (float)misses / triangles : 0.0f;
+}
+
+// quadric error metric (garland and heckbert 1997) of the planes around a
+// vertex: q(p) = p^T A p + 2 b.p + c summed over the planes. unweighted, so the
+// error bounds the distance to every plane rather than averaging thin parts away.
+// double, the terms cancel to nearly nothing for points on the planes
+typedef struct {
+    double a00, a01, a02, a11, a12, a22;
+    double b0, b1, b2;
+    double c;
+} quadric_t;
+
+static void quadric_add_plane(quadric_t* q, vec3 n, double d) {
+    q->a00 += n.x * n.x; q->a01 += n.x * n.y; q->a02 += n.x * n.z;
+    q->a11 += n.y * n.y; q->a12 += n.y * n.z; q->a22 += n.z * n.z;
+    q->b0 += n.x * d; q->b1 += n.y * d; q->b2 += n.z * d;
+    q->c += d * d;
+}
+
+static void quadric_add(quadric_t* q, const quadric_t* r) {
+    q->a00 += r->a00; q->a01 += r->a01; q->a02 += r->a02;
+    q->a11 += r->a11; q->a12 += r->a12; q->a22 += r->a22;
+    q->b0 += r->b0; q->b1 += r->b1; q->b2 += r->b2;
+    q->c += r->c;
+}
+
+// sum of the squared distances of p to the planes
+static float quadric_error(const quadric_t* q, vec3 p) {
+    const double x = p.x, y = p.y, z = p.z;
+    const double e = x * (q->a00 * x + 2.0 * (q->a01 * y + q->a02 * z + q->b0)) +
+                     y * (q->a11 * y + 2.0 * (q->a12 * z + q->b1)) +
+                     z * (q->a22 * z + 2.0 * q->b2) + q->c;
+    return (float)fabs(e);
+}
+
+typedef struct {
+    u32 from, to;
+    float cost;
+} collapse_t;
+
+static int collapse_compare(const void* a, const void* b) {
+    const float ca = ((const collapse_t*)a)->cost, cb = ((const collapse_t*)b)->cost;
+    return (ca > cb) - (ca < cb);
+}
+
+// edges are collapsed on the mesh welded by position, so uv and normal seams
+// do not stop it. corners keeps the real vertex of every corner, and a collapse
+// hands each corner of the moving vertex the vertex its triangles across the
+// collapsed edge used at the other end, which keeps seams seams
+typedef struct {
+    const vertex_t* vertices;
+    quadric_t* quadrics;
+    u8* locked;        // border vertices, never moved
+    const u32* wedges; // next vertex with the same position, in a ring
+    int* tri_start;    // triangles of each vertex in tri_list, -1 when unused
+    int* tri_count;
+    int* tri_list;
+    u8* touched;       // collapsed around this pass
+    collapse_t* best;  // cheapest collapse of each vertex
+    collapse_t* candidates;
+} simplifier_t;
+
+// triangles around every vertex of the index list, by first use
+static void simplifier_adjacency(simplifier_t* s, const u32* indices, int index_count) {
+    for (int i = 0; i < index_count; i++) {
+        s->tri_start[indices[i]] = -1;
+        s->tri_count[indices[i]] = 0;
+    }
+    for (int i = 0; i < index_count; i++) s->tri_count[indices[i]]++;
+    int next = 0;
+    for (int i = 0; i < index_count; i++) {
+        const u32 v = indices[i];
+        if (s->tri_start[v] >= 0) continue;
+        s->tri_start[v] = next;
+        next += s->tri_count[v];
+        s->tri_count[v] = 0;
+    }
+    for (int i = 0; i < index_count; i++) {
+        const u32 v = indices[i];
+        s->tri_list[s->tri_start[v] + s->tri_count[v]++] = i / 3;
+    }
+}
+
+// false when moving from onto to would turn one of from's other triangles over
+static bool collapse_flips(const simplifier_t* s, const u32* indices, u32 from, u32 to) {
+    const vec3 p_to = s->vertices[to].position;
+    for (int a = 0; a < s->tri_count[from]; a++) {
+        const u32* t = indices + s->tri_list[s->tri_start[from] + a] * 3;
+        if (t[0] == to || t[1] == to || t[2] == to) continue;
+
+        const int k = (t[0] == from) ? 0 : (t[1] == from) ? 1 : 2;
+        const vec3 p0 = s->vertices[t[k]].position;
+        const vec3 p1 = s->vertices[t[(k + 1) % 3]].position;
+        const vec3 p2 = s->vertices[t[(k + 2) % 3]].position;
+        const vec3 before = vec3_cross(vec3_sub(p1, p0), vec3_sub(p2, p0));
+        const vec3 after = vec3_cross(vec3_sub(p1, p_to), vec3_sub(p2, p_to));
+        if (vec3_dot(before, after) <= 0.0f) return true;
+    }
+    return false;
+}
+
+#define COLLAPSE_MAX_CORNERS 16
+
+// vertex at to's position with the attributes nearest to vertex v's
+static u32 nearest_wedge(const simplifier_t* s, u32 to, u32 v) {
+    const vertex_t* a = &s->vertices[v];
+    u32 best = to;
+    float best_distance = FLT_MAX;
+    u32 w = to;
+    do {
+        const vertex_t* b = &s->vertices[w];
+        const vec3 dn = vec3_sub(a->normal, b->normal);
+        const float du = a->texcoord.x - b->texcoord.x, dv = a->texcoord.y - b->texcoord.y;
+        const float distance = vec3_dot(dn, dn) + du * du + dv * dv;
+        if (distance < best_distance) {
+            best_distance = distance;
+            best = w;
+        }
+        w = s->wedges[w];
+    } while (w != to);
+    return best;
+}
+
+// which vertex each corner vertex of from turns into: the one the triangles
+// the collapse removes used at to, else the nearest in attributes (hard edges
+// and seams that from has to leave). false when two removed triangles disagree
+static bool collapse_corners(const simplifier_t* s, const u32* indices, const u32* corners, u32 from, u32 to, u32 map[COLLAPSE_MAX_CORNERS][2], int* map_count) {
+    *map_count = 0;
+    for (int a = 0; a < s->tri_count[from]; a++) {
+        const int t = s->tri_list[s->tri_start[from] + a] * 3;
+        const int kf = (indices[t] == from) ? 0 : (indices[t + 1] == from) ? 1 : 2;
+        const int kt = (indices[t] == to) ? 0 : (indices[t + 1] == to) ? 1 : (indices[t + 2] == to) ? 2 : -1;
+        if (kt < 0) continue;
+
+        int m = 0;
+        while (m < *map_count && map[m][0] != corners[t + kf]) m++;
+        if (m < *map_count) {
+            if (map[m][1] != corners[t + kt]) return false;
+            continue;
+        }
+        if (m == COLLAPSE_MAX_CORNERS) return false;
+        map[m][0] = corners[t + kf];
+        map[m][1] = corners[t + kt];
+        (*map_count)++;
+    }
+
+    for (int a = 0; a < s->tri_count[from]; a++) {
+        const int t = s->tri_list[s->tri_start[from] + a] * 3;
+        const int kf = (indices[t] == from) ? 0 : (indices[t + 1] == from) ? 1 : 2;
+        int m = 0;
+        while (m < *map_count && map[m][0] != corners[t + kf]) m++;
+        if (m < *map_count) continue;
+        if (m == COLLAPSE_MAX_CORNERS) return false;
+        map[m][0] = corners[t + kf];
+        map[m][1] = nearest_wedge(s, to, corners[t + kf]);
+        (*map_count)++;
+    }
+    return true;
+}
+
+// edge collapses onto existing vertices, cheapest first, in passes that leave
+// each other's neighbourhoods alone, until at most target indices are left or
+// nothing can collapse. indices are welded, corners the real vertices. returns
+// the new index count, *error grows to the root of the largest collapse cost
+static int simplify(simplifier_t* s, u32* indices, u32* corners, int index_count, int target, float* error) {
+    while (index_count > target) {
+        simplifier_adjacency(s, indices, index_count);
+        for (int i = 0; i < index_count; i++) {
+            s->touched[indices[i]] = 0;
+            s->best[indices[i]].cost = FLT_MAX;
+        }
+
+        for (int i = 0; i < index_count; i++) {
+            const u32 from = indices[i];
+            if (s->locked[from]) continue;
+            const u32* t = indices + (i / 3) * 3;
+            for (int k = 0; k < 3; k++) {
+                const u32 to = t[k];
+                if (to == from) continue;
+                const float cost = quadric_error(&s->quadrics[from], s->vertices[to].position);
+                if (cost < s->best[from].cost) s->best[from] = (collapse_t){ from, to, cost };
+            }
+        }
+
+        int candidate_count = 0;
+        for (int i = 0; i < index_count; i++) {
+            const u32 v = indices[i];
+            if (s->best[v].cost == FLT_MAX) continue;
+            s->candidates[candidate_count++] = s->best[v];
+            s->best[v].cost = FLT_MAX;
+        }
+        qsort(s->candidates, candidate_count, sizeof(collapse_t), collapse_compare);
+
+        int removed = 0, collapsed = 0;
+        for (int c = 0; c < candidate_count && index_count - removed * 3 > target; c++) {
+            const collapse_t* col = &s->candidates[c];
+            if (s->touched[col->from] || s->touched[col->to]) continue;
+            if (collapse_flips(s, indices, col->from, col->to)) continue;
+            u32 map[COLLAPSE_MAX_CORNERS][2];
+            int map_count;
+            if (!collapse_corners(s, indices, corners, col->from, col->to, map, &map_count)) continue;
+
+            for (int a = 0; a < s->tri_count[col->from]; a++) {
+                const int t = s->tri_list[s->tri_start[col->from] + a] * 3;
+                for (int k = 0; k < 3; k++) s->touched[indices[t + k]] = 1;
+                if (indices[t] == col->to || indices[t + 1] == col->to || indices[t + 2] == col->to) removed++;
+                for (int k = 0; k < 3; k++) {
+                    if (indices[t + k] != col->from) continue;
+                    indices[t + k] = col->to;
+                    for (int m = 0; m < map_count; m++) {
+                        if (map[m][0] == corners[t + k]) corners[t + k] = map[m][1];
+                    }
+                }
+            }
+            quadric_add(&s->quadrics[col->to], &s->quadrics[col->from]);
+            *error = fmaxf(*error, sqrtf(col->cost));
+            collapsed++;
+        }
+        if (collapsed == 0) break;
+
+        int kept = 0;
+        for (int i = 0; i < index_count; i += 3) {
+            const u32 a = indices[i], b = indices[i + 1], c = indices[i + 2];
+            if (a == b || b == c || c == a) continue;
+            corners[kept] = corners[i];
+            corners[kept + 1] = corners[i + 1];
+            corners[kept + 2] = corners[i + 2];
+            indices[kept++] = a;
+            indices[kept++] = b;
+            indices[kept++] = c;
+        }
+        index_count = kept;
+    }
+    return index_count;
+}
+
+static int position_compare(const void* a, const void* b) {
+    const vec3 pa = *(const vec3*)a, pb = *(const vec3*)b;
+    if (pa.x != pb.x) return (pa.x > pb.x) - (pa.x < pb.x);
+    if (pa.y != pb.y) return (pa.y > pb.y) - (pa.y < pb.y);
+    return (pa.z > pb.z) - (pa.z < pb.z);
+}
+
+// maps every vertex to the first one with the same position, and links the
+// vertices of each position into a ring
+static bool weld_positions(const mesh_t* mesh, u32* remap, u32* wedges) {
+    typedef struct { vec3 position; u32 index; } keyed_t;
+    keyed_t* keys = malloc(sizeof(keyed_t) * mesh->vertex_count);
+    if (!keys) return false;
+    for (int v = 0; v < mesh->vertex_count; v++) keys[v] = (keyed_t){ mesh->vertices[v].position, v };
+    qsort(keys, mesh->vertex_count, sizeof(keyed_t), position_compare);
+    u32 first = 0;
+    for (int v = 0; v < mesh->vertex_count; v++) {
+        if (v == 0 || position_compare(&keys[v - 1].position, &keys[v].position) != 0) first = keys[v].index;
+        remap[keys[v].index] = first;
+        const bool last = (v + 1 == mesh->vertex_count || position_compare(&keys[v].position, &keys[v + 1].position) != 0);
+        wedges[keys[v].index] = last ? first : keys[v + 1].index;
+    }
+    free(keys);
+    return true;
+}
+
+// locks the vertices of the submesh's border edges, where other submeshes
+// meet it, and of non-manifold edges. copies of a triangle, stacked or facing
+// the other way, do not count as its neighbours: the back of a double sided
+// sheet must not hide its border
+static void lock_borders(simplifier_t* s, const u32* indices, int index_count) {
+    simplifier_adjacency(s, indices, index_count);
+    for (int i = 0; i < index_count; i++) {
+        const u32* tri = indices + (i / 3) * 3;
+        const int k0 = i % 3;
+        const u32 a = tri[k0], b = tri[(k0 + 1) % 3], c = tri[(k0 + 2) % 3];
+
+        u32 across = UINT32_MAX; // third vertex of the triangles on the other side
+        bool manifold = true;
+        for (int n = 0; n < s->tri_count[b] && manifold; n++) {
+            const u32* t = indices + s->tri_list[s->tri_start[b] + n] * 3;
+            for (int k = 0; k < 3; k++) {
+                const u32 third = t[(k + 2) % 3];
+                if (third == c) continue;
+                if (t[k] == a && t[(k + 1) % 3] == b) manifold = false;
+                if (t[k] != b || t[(k + 1) % 3] != a) continue;
+                if (across != UINT32_MAX && across != third) manifold = false;
+                across = third;
+            }
+        }
+        if (!manifold || across == UINT32_MAX) {
+            s->locked[a] = 1;
+            s->locked[b] = 1;
+        }
+    }
+}
+
+void mesh_build_lods(mesh_t* mesh) {
+    int index_capacity = 0;
+    for (int i = 0; i < mesh->submesh_count; i++) {
+        if (mesh->submeshes[i].index_count > index_capacity) index_capacity = mesh->submeshes[i].index_count;
+    }
+
+    simplifier_t s = { .vertices = mesh->vertices };
+    u32* remap   = malloc(sizeof(u32) * mesh->vertex_count);
+    u32* wedges  = malloc(sizeof(u32) * mesh->vertex_count);
+    s.quadrics   = malloc(sizeof(quadric_t) * mesh->vertex_count);
+    s.locked     = malloc(mesh->vertex_count);
+    s.tri_start  = malloc(sizeof(int) * mesh->vertex_count);
+    s.tri_count  = malloc(sizeof(int) * mesh->vertex_count);
+    s.tri_list   = malloc(sizeof(int) * index_capacity);
+    s.touched    = malloc(mesh->vertex_count);
+    s.best       = malloc(sizeof(collapse_t) * mesh->vertex_count);
+    s.candidates = malloc(sizeof(collapse_t) * mesh->vertex_count);
+    u32* work    = malloc(sizeof(u32) * index_capacity);
+    u32* corners = malloc(sizeof(u32) * index_capacity);
+
+    if (!remap || !wedges || !corners || !s.quadrics || !s.locked || !s.tri_start || !s.tri_count || !s.tri_list || !s.touched || !s.best || !s.candidates || !work) {
+        printf("WARNING: mesh_build_lods: out of memory, submeshes keep full detail only\n");
+    } else if (!weld_positions(mesh, remap, wedges)) {
+        printf("WARNING: mesh_build_lods: out of memory, submeshes keep full detail only\n");
+    } else {
+        s.wedges = wedges;
+        for (int i = 0; i < mesh->submesh_count; i++) {
+            submesh_t* sub = &mesh->submeshes[i];
+            for (int l = 0; l < sub->lod_count; l++) array_free(sub->lods[l].indices);
+            array_free(sub->lods);
+            sub->lods = NULL;
+            sub->lod_count = 0;
+
+            int index_count = sub->index_count - sub->index_count % 3;
+            for (int k = 0; k < index_count; k++) {
+                const u32 v = remap[sub->indices[k]];
+                work[k] = v;
+                corners[k] = sub->indices[k];
+                s.quadrics[v] = (quadric_t){0};
+                s.locked[v] = 0;
+            }
+            for (int k = 0; k < index_count; k += 3) {
+                const vec3 p0 = mesh->vertices[work[k]].position;
+                const vec3 n = vec3_cross(vec3_sub(mesh->vertices[work[k + 1]].position, p0), vec3_sub(mesh->vertices[work[k + 2]].position, p0));
+                const float length = vec3_len(n);
+                if (length <= 0.0f) continue;
+                const vec3 unit = vec3_scale(n, 1.0f / length);
+                for (int c = 0; c < 3; c++) quadric_add_plane(&s.quadrics[work[k + c]], unit, -vec3_dot(unit, p0));
+            }
+            lock_borders(&s, work, index_count);
+
+            // each level keeps half the triangles of the last, as long as that still works
+            float error = 0.0f;
+            for (int l = 0; l < MESH_LOD_COUNT; l++) {
+                const int target = (index_count / 6) * 3;
+                const int simplified = simplify(&s, work, corners, index_count, target, &error);
+                if (simplified > index_count * 4 / 5 || simplified == 0) break;
+                index_count = simplified;
+
+                submesh_lod_t lod = { .indices = NULL, .index_count = index_count, .error = error };
+                lod.indices = array_hold(NULL, index_count, sizeof(u32));
+                memcpy(lod.indices, corners, sizeof(u32) * index_count);
+                array_push(sub->lods, lod);
+                sub->lod_count++;
+            }
+        }
+    }
+
+    free(remap);
+    free(wedges);
+    free(corners);
+    free(s.quadrics);
+    free(s.locked);
+    free(s.tri_start);
+    free(s.tri_count);
+    free(s.tri_list);
+    free(s.touched);
+    free(s.best);
+    free(s.candidates);
+    free(work);
+}
@@ -2,27 +2,109 @@
 #define MESH_H
 
 #include "vertex.h"
+#include "file.h"
+
+// object space bounding volumes, filled by mesh_compute_bounds
+typedef struct {
+    vec3 min;
+    vec3 max;
+    vec3 center; // sphere around the box center
+    float radius;
+} bounds_t;
+
+#define MESHLET_MAX_VERTICES 64
+#define MESHLET_MAX_TRIANGLES 124
+
+// run of neighbouring triangles in a submesh's index array, culled as a whole
+// against the frustum and, when all its faces point the same way, the camera
+typedef struct {
+    u32 index_offset;
+    u32 index_count;
+    bounds_t bounds;
+    vec3 cone_apex;   // normal cone: every face is back facing when seen from
+    vec3 cone_axis;   // a point inside the cone, with cos(angle to the axis)
+    float cone_cutoff; // above cone_cutoff. > 1 when the faces spread too far
+    bool occluded;    // failed the last occlusion test, so it is left for the second pass
+} meshlet_t;
+
+#define MESH_LOD_COUNT 3 // coarser levels mesh_build_lods tries for, each with half the triangles of the last
+
+// coarser index buffer over the same vertices, made by collapsing edges
+typedef struct {
+    u32* indices;  // dynamic array
+    int index_count;
+    float error;   // object space distance the surface may be off by
+} submesh_lod_t;
 
 typedef struct {
     u32* indices;
     int index_count;
     int material_id;
+    bounds_t bounds;
+    meshlet_t* meshlets; // dynamic array, empty until mesh_build_meshlets
+    int meshlet_count;
+    submesh_lod_t* lods; // dynamic array, coarsest last, empty until mesh_build_lods
+    int lod_count;
 } submesh_t;
 
+// structure-of-arrays copy of a mesh's vertices, one float stream per
+// attribute, for the 8-wide vertex stage. the streams share one 32 byte
+// aligned block and are padded with zeros to a multiple of 8 vertices
+typedef struct {
+    float* x;
+    float* y;
+    float* z;
+    float* nx;
+    float* ny;
+    float* nz;
+    float* u;
+    float* v;
+    int count;
+} vertex_streams_t;
+
 typedef struct {
     vertex_t* vertices;
     int vertex_count;
+    vertex_streams_t streams; // optional, empty until mesh_build_streams
+
+    // mesh cache the mesh was loaded from, when it is mapped the vertices and
+    // the index arrays of the submeshes and their lods point into it, read only
+    mapped_file_t cache;
 
     submesh_t* submeshes;
     int submesh_count;
 
+    bounds_t bounds; // all submeshes
+
     vec3 position;
     vec3 rotation;
     vec3 scale;
 
-    // TODO: bounding box for frustum culling
     // TODO: skeletal animation data
     // TODO: collision data for eventual physics engine
 } mesh_t;
 
+#define MESH_CACHE_SIZE 16 // fifo size mesh_optimize targets and mesh_acmr simulates
+
+bool mesh_build_streams(mesh_t* mesh);
+void mesh_free_streams(mesh_t* mesh);
+
+void mesh_compute_bounds(mesh_t* mesh);
+// splits every submesh into meshlets along its current index order, so it
+// belongs after mesh_optimize
+void mesh_build_meshlets(mesh_t* mesh);
+// quadric error simplification of every submesh into up to MESH_LOD_COUNT
+// coarser levels. vertices only collapse onto existing ones, so the levels
+// share the vertex buffer, and submesh borders stay where they are, so no
+// cracks open between submeshes
+void mesh_build_lods(mesh_t* mesh);
+
+// reorders every submesh's triangles for vertex reuse, then the vertices in
+// order of first use. false when out of memory, the mesh is then still valid
+// but its triangle order may be only partly optimized
+bool mesh_optimize(mesh_t* mesh);
+// average cache miss ratio: transformed vertices per triangle with a
+// MESH_CACHE_SIZE fifo that starts empty for every submesh
+float mesh_acmr(const mesh_t* mesh);
+
 #endif // MESH_H
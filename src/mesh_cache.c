@@ -0,0 +1,260 @@
+#include "mesh_cache.h"
+#include "array.h"
+#include <stdio.h>
+#include <string.h>
+
+#define MESH_CACHE_MAGIC 0x4853454du // "MESH"
+#define MESH_CACHE_ALIGN 16          // of every array in the file
+
+// the structs below are stored as they are, the sizes in the header make a
+// cache written by a build where they differ count as stale
+typedef struct {
+    u32 magic;
+    u32 version;
+    u32 vertex_size;
+    u32 meshlet_size;
+    u32 submesh_size;
+    i32 vertex_count;
+    i32 submesh_count;
+    i32 library_count;
+    mesh_cache_key_t key;
+    bounds_t bounds;
+    u64 vertices; // offsets from the start of the file
+    u64 libraries;
+    u64 materials; // one per submesh
+    u64 submeshes;
+} cache_header_t;
+
+typedef struct {
+    i32 index_count;
+    float error;
+    u64 indices;
+} cache_lod_t;
+
+typedef struct {
+    bounds_t bounds;
+    i32 index_count;
+    i32 meshlet_count;
+    i32 lod_count;
+    u64 indices;
+    u64 meshlets;
+    cache_lod_t lods[MESH_LOD_COUNT];
+} cache_submesh_t;
+
+// places size bytes after everything placed so far
+static u64 cache_place(u64* end, u64 size) {
+    const u64 offset = (*end + MESH_CACHE_ALIGN - 1) & ~(u64)(MESH_CACHE_ALIGN - 1);
+    *end = offset + size;
+    return offset;
+}
+
+static bool cache_write_at(FILE* file, u64 offset, const void* data, size_t size) {
+    if (size == 0) return true;
+    return fseek(file, (long)offset, SEEK_SET) == 0 && fwrite(data, 1, size, file) == size;
+}
+
+bool mesh_cache_write(const char* path, const mesh_cache_key_t* key, const mesh_t* mesh,
+                      const mesh_cache_library_t* libraries, int library_count,
+                      const mesh_cache_material_t* materials) {
+    cache_header_t header = {
+        .magic = MESH_CACHE_MAGIC,
+        .version = MESH_CACHE_VERSION,
+        .vertex_size = sizeof(vertex_t),
+        .meshlet_size = sizeof(meshlet_t),
+        .submesh_size = sizeof(cache_submesh_t),
+        .vertex_count = mesh->vertex_count,
+        .submesh_count = mesh->submesh_count,
+        .library_count = library_count,
+        .key = *key,
+        .bounds = mesh->bounds,
+    };
+
+    u64 end = sizeof(cache_header_t);
+    header.libraries = cache_place(&end, sizeof(mesh_cache_library_t) * library_count);
+    header.materials = cache_place(&end, sizeof(mesh_cache_material_t) * mesh->submesh_count);
+    header.submeshes = cache_place(&end, sizeof(cache_submesh_t) * mesh->submesh_count);
+    header.vertices = cache_place(&end, sizeof(vertex_t) * mesh->vertex_count);
+
+    cache_submesh_t* records = calloc(mesh->submesh_count + 1, sizeof(cache_submesh_t));
+    if (!records) return false;
+    for (int i = 0; i < mesh->submesh_count; i++) {
+        const submesh_t* sub = &mesh->submeshes[i];
+        cache_submesh_t* r = &records[i];
+        if (sub->lod_count > MESH_LOD_COUNT) {
+            free(records);
+            return false;
+        }
+        r->bounds = sub->bounds;
+        r->index_count = sub->index_count;
+        r->meshlet_count = sub->meshlet_count;
+        r->lod_count = sub->lod_count;
+        r->indices = cache_place(&end, sizeof(u32) * sub->index_count);
+        r->meshlets = cache_place(&end, sizeof(meshlet_t) * sub->meshlet_count);
+        for (int l = 0; l < sub->lod_count; l++) {
+            r->lods[l].index_count = sub->lods[l].index_count;
+            r->lods[l].error = sub->lods[l].error;
+            r->lods[l].indices = cache_place(&end, sizeof(u32) * sub->lods[l].index_count);
+        }
+    }
+
+    // written under a temporary name and renamed, so no reader maps half a cache
+    char temp_path[520];
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", path);
+    FILE* file = fopen(temp_path, "wb");
+    if (!file) {
+        free(records);
+        return false;
+    }
+
+    bool ok = cache_write_at(file, 0, &header, sizeof(header));
+    ok = ok && cache_write_at(file, header.libraries, libraries, sizeof(mesh_cache_library_t) * library_count);
+    ok = ok && cache_write_at(file, header.materials, materials, sizeof(mesh_cache_material_t) * mesh->submesh_count);
+    ok = ok && cache_write_at(file, header.submeshes, records, sizeof(cache_submesh_t) * mesh->submesh_count);
+    ok = ok && cache_write_at(file, header.vertices, mesh->vertices, sizeof(vertex_t) * mesh->vertex_count);
+    for (int i = 0; i < mesh->submesh_count && ok; i++) {
+        const submesh_t* sub = &mesh->submeshes[i];
+        const cache_submesh_t* r = &records[i];
+        ok = cache_write_at(file, r->indices, sub->indices, sizeof(u32) * sub->index_count);
+        ok = ok && cache_write_at(file, r->meshlets, sub->meshlets, sizeof(meshlet_t) * sub->meshlet_count);
+        for (int l = 0; l < sub->lod_count && ok; l++) {
+            ok = cache_write_at(file, r->lods[l].indices, sub->lods[l].indices, sizeof(u32) * sub->lods[l].index_count);
+        }
+    }
+    ok = (fclose(file) == 0) && ok;
+    free(records);
+
+    ok = ok && file_replace(temp_path, path);
+    if (!ok) remove(temp_path);
+    return ok;
+}
+
+// count elements of size bytes at offset lie inside the file, aligned
+static bool cache_fits(const mapped_file_t* file, u64 offset, i64 count, size_t size) {
+    if (count < 0 || offset > file->size || offset % MESH_CACHE_ALIGN != 0) return false;
+    return (u64)count <= (file->size - offset) / size;
+}
+
+// every index refers to one of the vertices
+static bool cache_indices_valid(const mapped_file_t* file, u64 offset, i32 count, i32 vertex_count) {
+    const u32* indices = (const u32*)(file->data + offset);
+    for (i32 i = 0; i < count; i++) {
+        if (indices[i] >= (u32)vertex_count) return false;
+    }
+    return true;
+}
+
+static bool cache_valid(const mapped_file_t* file, const mesh_cache_key_t* key) {
+    if (file->size < sizeof(cache_header_t)) return false;
+    const cache_header_t* header = (const cache_header_t*)file->data;
+    if (header->magic != MESH_CACHE_MAGIC || header->version != MESH_CACHE_VERSION) return false;
+    if (header->vertex_size != sizeof(vertex_t) || header->meshlet_size != sizeof(meshlet_t) ||
+        header->submesh_size != sizeof(cache_submesh_t)) return false;
+    if (header->key.size != key->size || header->key.mtime != key->mtime || header->key.hash != key->hash) return false;
+
+    if (!cache_fits(file, header->vertices, header->vertex_count, sizeof(vertex_t)) ||
+        !cache_fits(file, header->libraries, header->library_count, sizeof(mesh_cache_library_t)) ||
+        !cache_fits(file, header->materials, header->submesh_count, sizeof(mesh_cache_material_t)) ||
+        !cache_fits(file, header->submeshes, header->submesh_count, sizeof(cache_submesh_t))) return false;
+
+    // names are used as C strings, so each must end inside its field
+    const mesh_cache_library_t* libraries = (const mesh_cache_library_t*)(file->data + header->libraries);
+    for (int i = 0; i < header->library_count; i++) {
+        if (!memchr(libraries[i].name, '\0', sizeof(libraries[i].name))) return false;
+    }
+
+    const mesh_cache_material_t* materials = (const mesh_cache_material_t*)(file->data + header->materials);
+    const cache_submesh_t* records = (const cache_submesh_t*)(file->data + header->submeshes);
+    for (int i = 0; i < header->submesh_count; i++) {
+        const cache_submesh_t* r = &records[i];
+        if (!cache_fits(file, r->indices, r->index_count, sizeof(u32)) ||
+            !cache_fits(file, r->meshlets, r->meshlet_count, sizeof(meshlet_t)) ||
+            r->lod_count < 0 || r->lod_count > MESH_LOD_COUNT ||
+            materials[i].library < -1 || materials[i].library >= header->library_count ||
+            !memchr(materials[i].name, '\0', sizeof(materials[i].name))) return false;
+        if (!cache_indices_valid(file, r->indices, r->index_count, header->vertex_count)) return false;
+
+        const meshlet_t* meshlets = (const meshlet_t*)(file->data + r->meshlets);
+        for (int m = 0; m < r->meshlet_count; m++) {
+            if ((u64)meshlets[m].index_offset + meshlets[m].index_count > (u64)r->index_count) return false;
+        }
+        for (int l = 0; l < r->lod_count; l++) {
+            if (!cache_fits(file, r->lods[l].indices, r->lods[l].index_count, sizeof(u32)) ||
+                !cache_indices_valid(file, r->lods[l].indices, r->lods[l].index_count, header->vertex_count)) return false;
+        }
+    }
+    return true;
+}
+
+bool mesh_cache_load(const char* path, const mesh_cache_key_t* key, mesh_t* mesh,
+                     const mesh_cache_library_t** libraries, int* library_count,
+                     const mesh_cache_material_t** materials) {
+    mapped_file_t file;
+    if (!file_map(path, &file)) return false;
+    if (!cache_valid(&file, key)) {
+        file_unmap(&file);
+        return false;
+    }
+
+    const cache_header_t* header = (const cache_header_t*)file.data;
+    const cache_submesh_t* records = (const cache_submesh_t*)(file.data + header->submeshes);
+
+    mesh->vertices = (vertex_t*)(file.data + header->vertices);
+    mesh->vertex_count = header->vertex_count;
+    mesh->streams = (vertex_streams_t){0};
+    mesh->submeshes = NULL;
+    mesh->submesh_count = header->submesh_count;
+    mesh->bounds = header->bounds;
+    if (header->submesh_count > 0) {
+        mesh->submeshes = array_hold(NULL, header->submesh_count, sizeof(submesh_t));
+    }
+
+    for (int i = 0; i < header->submesh_count; i++) {
+        const cache_submesh_t* r = &records[i];
+        submesh_t* sub = &mesh->submeshes[i];
+        *sub = (submesh_t){
+            .indices = r->index_count ? (u32*)(file.data + r->indices) : NULL,
+            .index_count = r->index_count,
+            .material_id = -1,
+            .bounds = r->bounds,
+            .meshlets = NULL,
+            .meshlet_count = r->meshlet_count,
+            .lods = NULL,
+            .lod_count = r->lod_count,
+        };
+
+        // meshlets keep their occlusion state per frame, so they get a copy
+        if (r->meshlet_count > 0) {
+            sub->meshlets = array_hold(NULL, r->meshlet_count, sizeof(meshlet_t));
+            memcpy(sub->meshlets, file.data + r->meshlets, sizeof(meshlet_t) * r->meshlet_count);
+        }
+        if (r->lod_count > 0) {
+            sub->lods = array_hold(NULL, r->lod_count, sizeof(submesh_lod_t));
+            for (int l = 0; l < r->lod_count; l++) {
+                sub->lods[l] = (submesh_lod_t){
+                    .indices = (u32*)(file.data + r->lods[l].indices),
+                    .index_count = r->lods[l].index_count,
+                    .error = r->lods[l].error,
+                };
+            }
+        }
+    }
+
+    mesh->cache = file;
+    *libraries = (const mesh_cache_library_t*)(file.data + header->libraries);
+    *library_count = header->library_count;
+    *materials = (const mesh_cache_material_t*)(file.data + header->materials);
+    return true;
+}
+
+void mesh_cache_unload(mesh_t* mesh) {
+    for (int i = 0; i < mesh->submesh_count; i++) {
+        array_free(mesh->submeshes[i].meshlets);
+        array_free(mesh->submeshes[i].lods);
+    }
+    array_free(mesh->submeshes);
+    file_unmap(&mesh->cache);
+    mesh->vertices = NULL;
+    mesh->vertex_count = 0;
+    mesh->submeshes = NULL;
+    mesh->submesh_count = 0;
+}
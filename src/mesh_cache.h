@@ -0,0 +1,50 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+// binary copy of a loaded mesh, written next to its source so later loads
+// map it instead of parsing and processing the source again. vertices and
+// index arrays are used in place from the mapping, the small per submesh
+// data (meshlets, lod headers) is copied
+
+#include "mesh.h"
+
+#define MESH_CACHE_VERSION 2
+
+// what a cache was built from, it is only used while all of it matches
+typedef struct {
+    u64 size;
+    i64 mtime;
+    u64 hash;
+} mesh_cache_key_t;
+
+// material ids belong to the material manager, so the cache keeps where they
+// came from instead: the material libraries in load order, and for every
+// submesh the usemtl name and the library that was current when it was read
+// (library -1: none). which usemtl names resolve decides how faces are grouped
+// into submeshes, so a library also keeps the key of the file it was read from
+// (all zero when it did not exist)
+typedef struct {
+    char name[256];
+    mesh_cache_key_t key;
+} mesh_cache_library_t;
+
+typedef struct {
+    int library;
+    char name[128];
+} mesh_cache_material_t;
+
+bool mesh_cache_write(const char* path, const mesh_cache_key_t* key, const mesh_t* mesh,
+                      const mesh_cache_library_t* libraries, int library_count,
+                      const mesh_cache_material_t* materials);
+
+// fills mesh from the cache at path when it is valid for key, leaving the
+// material ids at -1 and the vertex streams empty. libraries and materials
+// point into the mapping
+bool mesh_cache_load(const char* path, const mesh_cache_key_t* key, mesh_t* mesh,
+                     const mesh_cache_library_t** libraries, int* library_count,
+                     const mesh_cache_material_t** materials);
+
+// releases a mesh filled by mesh_cache_load, for a cache found stale after loading
+void mesh_cache_unload(mesh_t* mesh);
+
+#endif // MESH_CACHE_H
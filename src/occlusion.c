@@ -0,0 +1,108 @@
+#include "occlusion.h"
+#include <float.h>
+
+// relative slack on the box test, so float error in the occluder's depth plane
+// can never hide geometry lying on the occluder itself
+#define OCCLUSION_EPSILON 1e-4f
+
+void occlusion_draw_triangle(framebuffer_t* fb, float x0, float y0, float w0, float x1, float y1, float w1, float x2, float y2, float w2) {
+    const int width = fb->occlusion_width;
+    const int height = fb->occlusion_height;
+    const float scale_x = (float)width / fb->width;
+    const float scale_y = (float)height / fb->height;
+    x0 *= scale_x; y0 *= scale_y;
+    x1 *= scale_x; y1 *= scale_y;
+    x2 *= scale_x; y2 *= scale_y;
+    float z0 = 1.0f / w0, z1 = 1.0f / w1, z2 = 1.0f / w2;
+
+    float area = (x1 - x0) * (y2 - y0) - (x2 - x0) * (y1 - y0);
+    if (area == 0.0f) return;
+    if (area < 0.0f) {
+        float t;
+        t = x1; x1 = x2; x2 = t;
+        t = y1; y1 = y2; y2 = t;
+        t = z1; z1 = z2; z2 = t;
+        area = -area;
+    }
+
+    // pixels whose center is covered, of which only the ones the triangle
+    // covers entirely are written below
+    const int min_x = (int)fmaxf(0.0f, ceilf(fminf(x0, fminf(x1, x2)) - 0.5f));
+    const int min_y = (int)fmaxf(0.0f, ceilf(fminf(y0, fminf(y1, y2)) - 0.5f));
+    const int max_x = (int)fminf(width - 1, floorf(fmaxf(x0, fmaxf(x1, x2)) - 0.5f));
+    const int max_y = (int)fminf(height - 1, floorf(fmaxf(y0, fmaxf(y1, y2)) - 0.5f));
+    if (min_x > max_x || min_y > max_y) return;
+
+    // the depth plane, lowered to its farthest value over the pixel square but
+    // never farther than the triangle's farthest vertex
+    const float dzdx = ((z1 - z0) * (y2 - y0) - (z2 - z0) * (y1 - y0)) / area;
+    const float dzdy = ((z2 - z0) * (x1 - x0) - (z1 - z0) * (x2 - x0)) / area;
+    const float margin = 0.5f * (fabsf(dzdx) + fabsf(dzdy));
+    const float z_floor = fminf(z0, fminf(z1, z2));
+
+    // inner coverage: each edge function is lowered to its smallest value over
+    // the pixel square, so a pixel passes only when all of it is inside. a
+    // pixel split between two occluders is left open rather than filled
+    const float px = min_x + 0.5f, py = min_y + 0.5f;
+    float e01_row = (x1 - x0) * (py - y0) - (y1 - y0) * (px - x0) - 0.5f * (fabsf(x1 - x0) + fabsf(y1 - y0));
+    float e12_row = (x2 - x1) * (py - y1) - (y2 - y1) * (px - x1) - 0.5f * (fabsf(x2 - x1) + fabsf(y2 - y1));
+    float e20_row = (x0 - x2) * (py - y2) - (y0 - y2) * (px - x2) - 0.5f * (fabsf(x0 - x2) + fabsf(y0 - y2));
+    float z_row = z0 + dzdx * (px - x0) + dzdy * (py - y0) - margin;
+
+    for (int y = min_y; y <= max_y; y++) {
+        float* row = fb->occlusion_buffer + y * width;
+        float e01 = e01_row, e12 = e12_row, e20 = e20_row, z = z_row;
+        for (int x = min_x; x <= max_x; x++) {
+            if (e01 >= 0 && e12 >= 0 && e20 >= 0) {
+                const float d = fmaxf(z, z_floor);
+                if (d > row[x]) row[x] = d;
+            }
+            e01 -= y1 - y0;
+            e12 -= y2 - y1;
+            e20 -= y0 - y2;
+            z += dzdx;
+        }
+        e01_row += x1 - x0;
+        e12_row += x2 - x1;
+        e20_row += x0 - x2;
+        z_row += dzdy;
+    }
+}
+
+bool occlusion_box_visible(const framebuffer_t* fb, const mat4* clip_transform, vec3 min, vec3 max) {
+    const int width = fb->occlusion_width;
+    const int height = fb->occlusion_height;
+
+    float min_x = FLT_MAX, min_y = FLT_MAX, max_x = -FLT_MAX, max_y = -FLT_MAX;
+    float min_w = FLT_MAX;
+    for (int i = 0; i < 8; i++) {
+        const vec4 corner = { (i & 1) ? max.x : min.x, (i & 2) ? max.y : min.y, (i & 4) ? max.z : min.z, 1.0f };
+        const vec4 p = mat4_mul_vec4(*clip_transform, corner);
+        if (p.z < 0.0f || p.w <= 0.0f) return true; // in front of the near plane, no screen rectangle
+
+        const float rcp_w = 1.0f / p.w;
+        const float x = (0.5f - 0.5f * p.x * rcp_w) * width;
+        const float y = (0.5f - 0.5f * p.y * rcp_w) * height;
+        min_x = fminf(min_x, x); max_x = fmaxf(max_x, x);
+        min_y = fminf(min_y, y); max_y = fmaxf(max_y, y);
+        min_w = fminf(min_w, p.w);
+    }
+
+    // every pixel the screen rectangle touches, occluders only fill pixels
+    // they cover entirely
+    const int x0 = (int)fmaxf(0.0f, floorf(min_x));
+    const int y0 = (int)fmaxf(0.0f, floorf(min_y));
+    const int x1 = (int)fminf(width - 1, floorf(max_x));
+    const int y1 = (int)fminf(height - 1, floorf(max_y));
+    if (x0 > x1 || y0 > y1) return true;
+
+    // hidden only where every pixel holds an occluder nearer than the box's nearest corner
+    const float depth = (1.0f / min_w) * (1.0f + OCCLUSION_EPSILON);
+    for (int y = y0; y <= y1; y++) {
+        const float* row = fb->occlusion_buffer + y * width;
+        for (int x = x0; x <= x1; x++) {
+            if (row[x] <= depth) return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,21 @@
+#ifndef OCCLUSION_H
+#define OCCLUSION_H
+
+// software occlusion culling: occluders are rasterized depth only into a small
+// buffer covering the whole viewport, and bounding boxes are tested against it
+// before their triangles are transformed. a pixel is only written where one
+// occluder covers all of it, and then with the farthest depth the occluder has
+// over it, so a box behind it is hidden at full resolution too
+
+#include "graphics.h"
+
+#define OCCLUSION_WIDTH  256
+#define OCCLUSION_HEIGHT 128
+
+// depth only triangle in framebuffer pixel coordinates, w as passed to the rasterizers
+void occlusion_draw_triangle(framebuffer_t* fb, float x0, float y0, float w0, float x1, float y1, float w1, float x2, float y2, float w2);
+
+// false when the object space box lies entirely behind the occluders drawn so far
+bool occlusion_box_visible(const framebuffer_t* fb, const mat4* clip_transform, vec3 min, vec3 max);
+
+#endif // OCCLUSION_H
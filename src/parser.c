@@ -1,155 +1,657 @@
+#define _DEFAULT_SOURCE // for clock_gettime
 #include "parser.h"
+#include "file.h"
+#include "thread.h"
+#include "mesh_cache.h"
+#include <limits.h>
 
-char* trim_whitespace(char* str) {
-    char* end;
-    while(isspace((unsigned char)*str)) str++;
-    if(*str == 0) return str;
-    end = str + strlen(str) - 1;
-    while(end > str && isspace((unsigned char)*end)) end--;
-    end[1] = '\0';
-    return str;
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+// the text parsers walk a mapped file in place, a line at a time, with the
+// cursor moving towards the end of the line and never past it
+
+static const char* line_end_of(const char* c, const char* end) {
+    const char* newline = memchr(c, '\n', end - c);
+    return newline ? newline : end;
+}
+
+static const char* skip_blanks(const char* c, const char* end) {
+    while (c < end && (*c == ' ' || *c == '\t' || *c == '\r')) c++;
+    return c;
+}
+
+static bool is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+// consumes keyword when it is the next token and is followed by a blank
+static bool match_keyword(const char** cursor, const char* end, const char* keyword) {
+    const size_t length = strlen(keyword);
+    const char* c = *cursor;
+    if ((size_t)(end - c) <= length || memcmp(c, keyword, length) != 0) return false;
+    if (c[length] != ' ' && c[length] != '\t') return false;
+    *cursor = skip_blanks(c + length, end);
+    return true;
+}
+
+static bool match_char(const char** cursor, const char* end, char expected) {
+    if (*cursor >= end || **cursor != expected) return false;
+    (*cursor)++;
+    return true;
+}
+
+static bool parse_int(const char** cursor, const char* end, int* out) {
+    const char* c = skip_blanks(*cursor, end);
+    bool negative = false;
+    if (c < end && (*c == '-' || *c == '+')) negative = *c++ == '-';
+    if (c >= end || !is_digit(*c)) return false;
+
+    int value = 0;
+    for (; c < end && is_digit(*c); c++) {
+        value = (value < INT_MAX / 10 - 1) ? value * 10 + (*c - '0') : INT_MAX;
+    }
+    *out = negative ? -value : value;
+    *cursor = c;
+    return true;
+}
+
+// exact in double, so a mantissa of up to 2^53 scaled by one of them is
+// rounded only once
+static const double powers_of_ten[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+// decimal and exponent notation, numbers with more digits or a larger scale
+// than the fast path handles exactly go through strtod
+static bool parse_float(const char** cursor, const char* end, float* out) {
+    const char* start = skip_blanks(*cursor, end);
+    const char* c = start;
+    bool negative = false;
+    if (c < end && (*c == '-' || *c == '+')) negative = *c++ == '-';
+
+    u64 mantissa = 0;
+    int digits = 0, exponent = 0;
+    bool any_digit = false, truncated = false;
+    for (; c < end && is_digit(*c); c++) {
+        any_digit = true;
+        if (digits < 19) {
+            mantissa = mantissa * 10 + (u64)(*c - '0');
+            if (mantissa) digits++;
+        } else {
+            exponent++;
+            truncated |= *c != '0';
+        }
+    }
+    if (c < end && *c == '.') {
+        for (c++; c < end && is_digit(*c); c++) {
+            any_digit = true;
+            if (digits < 19) {
+                mantissa = mantissa * 10 + (u64)(*c - '0');
+                if (mantissa) digits++;
+                exponent--;
+            } else {
+                truncated |= *c != '0';
+            }
+        }
+    }
+    if (!any_digit) return false;
+
+    if (c < end && (*c == 'e' || *c == 'E')) {
+        const char* e = c + 1;
+        int scale;
+        if (e < end && (is_digit(*e) || ((*e == '-' || *e == '+') && e + 1 < end && is_digit(e[1])))) {
+            parse_int(&e, end, &scale);
+            if (scale > 1000) scale = 1000;
+            if (scale < -1000) scale = -1000;
+            exponent += scale;
+            c = e;
+        }
+    }
+
+    double value;
+    if (!truncated && mantissa <= (1ull << 53) && exponent >= -22 && exponent <= 22) {
+        value = (exponent < 0) ? (double)mantissa / powers_of_ten[-exponent]
+                               : (double)mantissa * powers_of_ten[exponent];
+        if (negative) value = -value;
+    } else {
+        char buffer[64];
+        const size_t length = ((size_t)(c - start) < sizeof(buffer) - 1) ? (size_t)(c - start) : sizeof(buffer) - 1;
+        memcpy(buffer, start, length);
+        buffer[length] = '\0';
+        value = strtod(buffer, NULL);
+    }
+
+    *out = (float)value;
+    *cursor = c;
+    return true;
+}
+
+// each component is written only once it parsed, like scanf would
+static bool parse_vec2(const char** cursor, const char* end, vec2* out) {
+    return parse_float(cursor, end, &out->x) && parse_float(cursor, end, &out->y);
+}
+
+static bool parse_vec3(const char** cursor, const char* end, vec3* out) {
+    return parse_float(cursor, end, &out->x) && parse_float(cursor, end, &out->y) && parse_float(cursor, end, &out->z);
+}
+
+// the rest of the line without trailing blanks, cut to fit out
+static void copy_rest_of_line(const char* c, const char* end, char* out, size_t size) {
+    while (end > c && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r')) end--;
+    size_t length = (size_t)(end - c);
+    if (length > size - 1) length = size - 1;
+    memcpy(out, c, length);
+    out[length] = '\0';
+}
+
+static double seconds_now(void) {
+#ifdef _WIN32
+    LARGE_INTEGER counter, frequency;
+    QueryPerformanceCounter(&counter);
+    QueryPerformanceFrequency(&frequency);
+    return (double)counter.QuadPart / (double)frequency.QuadPart;
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + (double)now.tv_nsec * 1e-9;
+#endif
+}
+
+// face corners are deduplicated by their vertex contents, as memcmp sees them,
+// in an open addressing table of vertex indices, kept at most half full
+typedef struct {
+    u32* slots; // vertex index + 1, 0 for an empty slot
+    u32 mask;
+    int count;
+} vertex_table_t;
+
+static u32 vertex_hash(const vertex_t* v) {
+    u32 words[sizeof(vertex_t) / sizeof(u32)];
+    memcpy(words, v, sizeof(words));
+    u32 h = 0x811c9dc5u;
+    for (size_t i = 0; i < sizeof(words) / sizeof(u32); i++) {
+        h = (h ^ words[i]) * 0x9e3779b1u;
+        h ^= h >> 15;
+    }
+    return h;
+}
+
+static bool vertex_table_init(vertex_table_t* table, int expected) {
+    u32 capacity = 64;
+    while (capacity < (u32)expected * 2) capacity *= 2;
+    table->slots = calloc(capacity, sizeof(u32));
+    table->mask = capacity - 1;
+    table->count = 0;
+    return table->slots != NULL;
+}
+
+static u32* vertex_table_find(vertex_table_t* table, const vertex_t* vertices, const vertex_t* v) {
+    u32 i = vertex_hash(v) & table->mask;
+    while (table->slots[i] && memcmp(&vertices[table->slots[i] - 1], v, sizeof(vertex_t)) != 0) {
+        i = (i + 1) & table->mask;
+    }
+    return &table->slots[i];
+}
+
+static bool vertex_table_grow(vertex_table_t* table, const vertex_t* vertices) {
+    vertex_table_t grown;
+    if (!vertex_table_init(&grown, table->mask + 1)) return false;
+    for (u32 i = 0; i <= table->mask; i++) {
+        const u32 slot = table->slots[i];
+        if (slot) *vertex_table_find(&grown, vertices, &vertices[slot - 1]) = slot;
+    }
+    grown.count = table->count;
+    free(table->slots);
+    *table = grown;
+    return true;
 }
 
 static u32 find_or_add_vertex(
     mesh_t* mesh,
+    vertex_table_t* table,
     vertex_t new_vertex
 ) {
-    for (int i = 0; i < mesh->vertex_count; i++) {
-        if (memcmp(&mesh->vertices[i], &new_vertex, sizeof(vertex_t)) == 0) {
-            return i; 
-        }
+    // without a table (it could not grow) every corner gets its own vertex
+    u32* slot = NULL;
+    if (table->slots) {
+        slot = vertex_table_find(table, mesh->vertices, &new_vertex);
+        if (*slot) return *slot - 1;
     }
 
     u32 new_index = mesh->vertex_count;
     array_push(mesh->vertices, new_vertex);
     mesh->vertex_count++;
-    
+    if (!slot) return new_index;
+
+    // a full table would never end a probe, so deduplication stops instead
+    *slot = new_index + 1;
+    if (++table->count * 2 > (int)table->mask + 1 && !vertex_table_grow(table, mesh->vertices)) {
+        printf("WARNING: find_or_add_vertex: out of memory growing the vertex table, vertices are no longer deduplicated\n");
+        free(table->slots);
+        table->slots = NULL;
+    }
     return new_index;
 }
 
-void load_obj(const char* path, mesh_t* mesh, material_manager_t* m) {
-    FILE* file = fopen(path, "r");
-    if (!file) {
+// line counts of the element types, of the whole file or of one chunk
+typedef struct {
+    int positions, texcoords, normals, faces;
+} obj_counts_t;
+
+// a face as written, with its indices made absolute and 1-based. corners
+// points at the text of a face that did not parse, for the warning
+typedef struct {
+    int p[3], t[3], n[3]; // position, texcoord, normal indices
+    const char* corners;
+} obj_face_t;
+
+// mtllib and usemtl lines, replayed in file order before the face they precede
+typedef struct {
+    bool is_library;
+    int face; // faces before it in the whole file
+    char name[256];
+} obj_event_t;
+
+// the file is split on line boundaries into chunks parsed on the worker pool. each
+// chunk counts its lines first, the counts are prefix summed into where its
+// elements start in the shared arrays, and it then parses straight into them
+typedef struct {
+    const char* begin;
+    const char* end;
+    obj_counts_t counts;
+    obj_counts_t base; // counts of all the chunks before it
+    vec3* positions;
+    vec2* texcoords;
+    vec3* normals;
+    obj_face_t* faces;
+    obj_event_t* events;
+} obj_chunk_t;
+
+#define OBJ_MAX_CHUNKS 64
+#define OBJ_MIN_CHUNK_SIZE (256 * 1024)
+
+static int split_obj_chunks(const char* data, const char* end, obj_chunk_t* chunks, int thread_count) {
+    const size_t size = (size_t)(end - data);
+    int count = thread_count;
+    if (count > OBJ_MAX_CHUNKS) count = OBJ_MAX_CHUNKS;
+    if ((size_t)count > size / OBJ_MIN_CHUNK_SIZE) count = (int)(size / OBJ_MIN_CHUNK_SIZE);
+    if (count < 1) count = 1;
+
+    const char* begin = data;
+    for (int i = 0; i < count; i++) {
+        const char* split = end;
+        if (i < count - 1) {
+            split = data + size / count * (i + 1);
+            if (split < begin) split = begin;
+            split = line_end_of(split, end);
+            if (split < end) split++;
+        }
+        chunks[i] = (obj_chunk_t){ .begin = begin, .end = split };
+        begin = split;
+    }
+    return count;
+}
+
+// one task per chunk on the worker pool
+static void count_obj_chunk(void* arg, int task) {
+    obj_chunk_t* chunk = (obj_chunk_t*)arg + task;
+    obj_counts_t counts = {0};
+    for (const char* c = chunk->begin; c < chunk->end; c = line_end_of(c, chunk->end) + 1) {
+        c = skip_blanks(c, chunk->end);
+        if (match_keyword(&c, chunk->end, "v")) counts.positions++;
+        else if (match_keyword(&c, chunk->end, "vt")) counts.texcoords++;
+        else if (match_keyword(&c, chunk->end, "vn")) counts.normals++;
+        else if (match_keyword(&c, chunk->end, "f")) counts.faces++;
+    }
+    chunk->counts = counts;
+}
+
+// positive indices count from the start of the file, negative ones back from
+// the last element defined before the face
+static int resolve_index(int index, int defined) {
+    return (index < 0) ? defined + index + 1 : index;
+}
+
+static void parse_obj_chunk(void* arg, int task) {
+    obj_chunk_t* chunk = (obj_chunk_t*)arg + task;
+    obj_counts_t local = {0};
+
+    for (const char* line = chunk->begin; line < chunk->end; ) {
+        const char* const line_end = line_end_of(line, chunk->end);
+        const char* c = skip_blanks(line, line_end);
+        line = line_end + 1;
+
+        // skip blank lines and comments
+        if (c == line_end || *c == '#') continue;
+
+        if (match_keyword(&c, line_end, "v")) {
+            vec3 pos = {0};
+            parse_vec3(&c, line_end, &pos);
+            chunk->positions[local.positions++] = pos;
+        } else if (match_keyword(&c, line_end, "vt")) {
+            vec2 uv = {0};
+            parse_vec2(&c, line_end, &uv);
+            uv.y = 1.0f - uv.y;
+            chunk->texcoords[local.texcoords++] = uv;
+        } else if (match_keyword(&c, line_end, "vn")) {
+            vec3 norm = {0};
+            parse_vec3(&c, line_end, &norm);
+            chunk->normals[local.normals++] = norm;
+        } else if (match_keyword(&c, line_end, "mtllib")) {
+            obj_event_t event = { .is_library = true, .face = chunk->base.faces + local.faces };
+            copy_rest_of_line(c, line_end, event.name, sizeof(event.name));
+            array_push(chunk->events, event);
+        } else if (match_keyword(&c, line_end, "usemtl")) {
+            // cut like the material names it is compared against
+            obj_event_t event = { .is_library = false, .face = chunk->base.faces + local.faces };
+            copy_rest_of_line(c, line_end, event.name, sizeof(((material_lookup_t*)0)->name));
+            array_push(chunk->events, event);
+        } else if (match_keyword(&c, line_end, "f")) {
+            obj_face_t* face = &chunk->faces[local.faces++];
+            face->corners = c;
+
+            bool matched = true;
+            for (int i = 0; i < 3 && matched; i++) {
+                matched = parse_int(&c, line_end, &face->p[i]) && match_char(&c, line_end, '/') &&
+                          parse_int(&c, line_end, &face->t[i]) && match_char(&c, line_end, '/') &&
+                          parse_int(&c, line_end, &face->n[i]);
+            }
+            if (!matched) continue;
+
+            for (int i = 0; i < 3; i++) {
+                face->p[i] = resolve_index(face->p[i], chunk->base.positions + local.positions);
+                face->t[i] = resolve_index(face->t[i], chunk->base.texcoords + local.texcoords);
+                face->n[i] = resolve_index(face->n[i], chunk->base.normals + local.normals);
+            }
+            face->corners = NULL;
+        }
+    }
+}
+
+// room for count elements without changing the array's length
+#define array_reserve(array, count)                                           \
+    do {                                                                      \
+        if ((count) > 0) {                                                    \
+            (array) = array_hold((array), (count), sizeof(*(array)));         \
+            array_clear(array);                                               \
+        }                                                                     \
+    } while (0)
+
+// the material libraries of a cached mesh are loaded again, in the same
+// order, which recreates its materials with the same ids
+// what a material library was read from, all zero when it cannot be read
+static mesh_cache_key_t library_key(const char* mtl_path) {
+    mesh_cache_key_t key = {0};
+    mapped_file_t file;
+    if (!file_map(mtl_path, &file)) return key;
+    key.hash = file_hash(file.data, file.size);
+    file_unmap(&file);
+    file_stat(mtl_path, &key.size, &key.mtime);
+    return key;
+}
+
+static bool load_cached_obj(const char* cache_path, const mesh_cache_key_t* key, const char* obj_dir, mesh_t* mesh, material_manager_t* m) {
+    const mesh_cache_library_t* libraries;
+    const mesh_cache_material_t* materials;
+    int library_count;
+    if (!mesh_cache_load(cache_path, key, mesh, &libraries, &library_count, &materials)) return false;
+
+    // an edited library can resolve other usemtl names, and so group the faces differently
+    for (int l = 0; l < library_count; l++) {
+        char mtl_path[512];
+        snprintf(mtl_path, sizeof(mtl_path), "%s%s", obj_dir, libraries[l].name);
+        const mesh_cache_key_t current = library_key(mtl_path);
+        if (current.size != libraries[l].key.size || current.mtime != libraries[l].key.mtime || current.hash != libraries[l].key.hash) {
+            mesh_cache_unload(mesh);
+            return false;
+        }
+    }
+
+    material_lookup_t* material_lookups = NULL;
+    int material_lookup_count = 0;
+    for (int l = 0; l < library_count; l++) {
+        char mtl_path[512];
+        snprintf(mtl_path, sizeof(mtl_path), "%s%s", obj_dir, libraries[l].name);
+        array_free(material_lookups);
+        material_lookup_count = load_mtl(mtl_path, obj_dir, m, &material_lookups);
+
+        for (int i = 0; i < mesh->submesh_count; i++) {
+            if (materials[i].library != l) continue;
+            for (int j = 0; j < material_lookup_count; j++) {
+                if (strcmp(material_lookups[j].name, materials[i].name) == 0) {
+                    mesh->submeshes[i].material_id = material_lookups[j].material_id;
+                    break;
+                }
+            }
+        }
+    }
+    array_free(material_lookups);
+
+    mesh_build_streams(mesh);
+    return true;
+}
+
+void load_obj(const char* path, mesh_t* mesh, material_manager_t* m, worker_pool_t* pool) {
+    const double start_time = seconds_now();
+    mapped_file_t file;
+    if (!file_map(path, &file)) {
         printf("ERROR: Unable to open OBJ file: %s\n", path);
         return;
     }
+    const char* const end = file.data + file.size;
+    const size_t file_size = file.size;
+
+    char obj_dir[512] = "./";
+    const char* last_slash = strrchr(path, '/');
+    if (last_slash) {
+        strncpy(obj_dir, path, last_slash - path + 1);
+        obj_dir[last_slash - path + 1] = '\0';
+    }
+
+    char cache_path[512];
+    snprintf(cache_path, sizeof(cache_path), "%s.meshcache", path);
+    mesh_cache_key_t cache_key = { .hash = file_hash(file.data, file.size) };
+    const bool has_key = file_stat(path, &cache_key.size, &cache_key.mtime);
+    if (has_key && load_cached_obj(cache_path, &cache_key, obj_dir, mesh, m)) {
+        file_unmap(&file);
+        printf("INFO: Loaded OBJ from %s in %.1f ms: %d vertices, %d submeshes\n",
+               cache_path, (seconds_now() - start_time) * 1000.0, mesh->vertex_count, mesh->submesh_count);
+        return;
+    }
 
-    vec3* temp_positions = NULL;
-    vec2* temp_texcoords = NULL;
-    vec3* temp_normals = NULL;
+    obj_chunk_t chunks[OBJ_MAX_CHUNKS];
+    const int chunk_count = split_obj_chunks(file.data, end, chunks, pool_thread_count(pool));
+    pool_run(pool, count_obj_chunk, chunks, chunk_count);
+
+    obj_counts_t counts = {0};
+    for (int i = 0; i < chunk_count; i++) {
+        chunks[i].base = counts;
+        counts.positions += chunks[i].counts.positions;
+        counts.texcoords += chunks[i].counts.texcoords;
+        counts.normals += chunks[i].counts.normals;
+        counts.faces += chunks[i].counts.faces;
+    }
+
+    // every attribute is referenced at least once, so the largest count is the
+    // least number of vertices there will be
+    int expected_vertices = counts.positions;
+    if (counts.texcoords > expected_vertices) expected_vertices = counts.texcoords;
+    if (counts.normals > expected_vertices) expected_vertices = counts.normals;
+    if (expected_vertices > counts.faces * 3) expected_vertices = counts.faces * 3;
+
+    vec3* positions = malloc(sizeof(vec3) * counts.positions);
+    vec2* texcoords = malloc(sizeof(vec2) * counts.texcoords);
+    vec3* normals = malloc(sizeof(vec3) * counts.normals);
+    obj_face_t* faces = malloc(sizeof(obj_face_t) * counts.faces);
+    vertex_table_t vertex_table = {0};
+    if ((counts.positions && !positions) || (counts.texcoords && !texcoords) || (counts.normals && !normals) ||
+        (counts.faces && !faces) || !vertex_table_init(&vertex_table, expected_vertices)) {
+        printf("ERROR: Out of memory loading OBJ file: %s\n", path);
+        file_unmap(&file);
+        free(positions);
+        free(texcoords);
+        free(normals);
+        free(faces);
+        free(vertex_table.slots);
+        return;
+    }
+
+    for (int i = 0; i < chunk_count; i++) {
+        chunks[i].positions = positions + chunks[i].base.positions;
+        chunks[i].texcoords = texcoords + chunks[i].base.texcoords;
+        chunks[i].normals = normals + chunks[i].base.normals;
+        chunks[i].faces = faces + chunks[i].base.faces;
+        chunks[i].events = NULL;
+    }
+    pool_run(pool, parse_obj_chunk, chunks, chunk_count);
 
     mesh->vertices = NULL;
     mesh->submeshes = NULL;
     mesh->vertex_count = 0;
     mesh->submesh_count = 0;
+    mesh->streams = (vertex_streams_t){0};
+    mesh->cache = (mapped_file_t){0};
+    mesh->bounds = (bounds_t){0};
+    array_reserve(mesh->vertices, expected_vertices);
     
     material_lookup_t* material_lookups = NULL;
     int material_lookup_count = 0;
     int current_submesh_index = -1;
+    double mtl_seconds = 0.0;
 
-    char obj_dir[512] = "./";
-    const char* last_slash = strrchr(path, '/');
-    if (last_slash) {
-        strncpy(obj_dir, path, last_slash - path + 1);
-        obj_dir[last_slash - path + 1] = '\0';
-    }
+    // where the materials came from, for the cache
+    mesh_cache_library_t* cache_libraries = NULL;
+    mesh_cache_material_t* cache_materials = NULL;
 
-    char line[1024];
-    while (fgets(line, sizeof(line), file)) {
-        char* trimmed = trim_whitespace(line);
-        if (strlen(trimmed) == 0) continue;
+    // materials, submeshes and vertex dedup run in file order, so the mesh
+    // comes out the same however the file was split
+    for (int k = 0; k < chunk_count; k++) {
+        const obj_chunk_t* chunk = &chunks[k];
+        const int event_count = array_length(chunk->events);
+        const int faces_end = chunk->base.faces + chunk->counts.faces;
+        int e = 0;
+        for (int f = chunk->base.faces; ; f++) {
+            for (; e < event_count && chunk->events[e].face == f; e++) {
+                const obj_event_t* event = &chunk->events[e];
+                if (event->is_library) {
+                    char mtl_path[512];
+                    snprintf(mtl_path, sizeof(mtl_path), "%s%s", obj_dir, event->name);
+                    const double mtl_start = seconds_now();
+                    array_free(material_lookups);
+                    material_lookup_count = load_mtl(mtl_path, obj_dir, m, &material_lookups);
+                    mesh_cache_library_t library = { .key = library_key(mtl_path) };
+                    mtl_seconds += seconds_now() - mtl_start;
 
-        // skip comments
-        if (trimmed[0] == '#') continue;
+                    copy_rest_of_line(event->name, event->name + strlen(event->name), library.name, sizeof(library.name));
+                    array_push(cache_libraries, library);
+                    continue;
+                }
 
-        if (strncmp(trimmed, "v ", 2) == 0) {
-            vec3 pos;
-            sscanf(trimmed + 2, "%f %f %f", &pos.x, &pos.y, &pos.z);
-            array_push(temp_positions, pos);
-        } else if (strncmp(trimmed, "vt ", 3) == 0) {
-            vec2 uv;
-            sscanf(trimmed + 3, "%f %f", &uv.x, &uv.y);
-            uv.y = 1.0f - uv.y;
-            array_push(temp_texcoords, uv);
-        } else if (strncmp(trimmed, "vn ", 3) == 0) {
-            vec3 norm;
-            sscanf(trimmed + 3, "%f %f %f", &norm.x, &norm.y, &norm.z);
-            array_push(temp_normals, norm);
-        } else if (strncmp(trimmed, "mtllib ", 7) == 0) {
-            char mtl_filename[256];
-            strncpy(mtl_filename, trimmed + 7, sizeof(mtl_filename) - 1);
-            mtl_filename[sizeof(mtl_filename) - 1] = '\0';
-
-            char mtl_path[512];
-            snprintf(mtl_path, sizeof(mtl_path), "%s%s", obj_dir, mtl_filename);
-            material_lookup_count = load_mtl(mtl_path, obj_dir, m, &material_lookups);
-        } else if (strncmp(trimmed, "usemtl ", 7) == 0) {
-            char mtl_name[128];
-            strncpy(mtl_name, trimmed + 7, sizeof(mtl_name) - 1);
-            mtl_name[sizeof(mtl_name) - 1] = '\0';
-            
-            int material_id = -1;
-            for (int i = 0; i < material_lookup_count; i++) {
-                if (strcmp(material_lookups[i].name, mtl_name) == 0) {
-                    material_id = material_lookups[i].material_id;
-                    break;
+                int material_id = -1;
+                mesh_cache_material_t material_source = { .library = array_length(cache_libraries) - 1 };
+                copy_rest_of_line(event->name, event->name + strlen(event->name), material_source.name, sizeof(material_source.name));
+                for (int i = 0; i < material_lookup_count; i++) {
+                    if (strcmp(material_lookups[i].name, event->name) == 0) {
+                        material_id = material_lookups[i].material_id;
+                        break;
+                    }
                 }
-            }
-            
-            current_submesh_index = -1;
-            for (int i = 0; i < mesh->submesh_count; i++) {
-                if (mesh->submeshes[i].material_id == material_id) {
-                    current_submesh_index = i;
-                    break;
+
+                current_submesh_index = -1;
+                for (int i = 0; i < mesh->submesh_count; i++) {
+                    if (mesh->submeshes[i].material_id == material_id) {
+                        current_submesh_index = i;
+                        break;
+                    }
                 }
-            }
 
-            if (current_submesh_index == -1) {
-                submesh_t new_sub = { .indices = NULL, .index_count = 0, .material_id = material_id };
-                array_push(mesh->submeshes, new_sub);
-                mesh->submesh_count++;
-                current_submesh_index = mesh->submesh_count - 1;
+                if (current_submesh_index == -1) {
+                    submesh_t new_sub = { .indices = NULL, .index_count = 0, .material_id = material_id, .meshlets = NULL, .lods = NULL };
+                    array_push(mesh->submeshes, new_sub);
+                    array_push(cache_materials, material_source);
+                    mesh->submesh_count++;
+                    current_submesh_index = mesh->submesh_count - 1;
+                }
             }
+            if (f == faces_end) break;
 
-        } else if (strncmp(trimmed, "f ", 2) == 0) {
             if (current_submesh_index < 0) {
-                 submesh_t default_sub = { .indices = NULL, .index_count = 0, .material_id = -1 };
+                 submesh_t default_sub = { .indices = NULL, .index_count = 0, .material_id = -1, .meshlets = NULL, .lods = NULL };
+                 const mesh_cache_material_t no_material = { .library = -1 };
                  array_push(mesh->submeshes, default_sub);
+                 array_push(cache_materials, no_material);
                  mesh->submesh_count++;
                  current_submesh_index = mesh->submesh_count - 1;
             }
-            
-            int p[3], t[3], n[3]; // position, texcoord, normal indices
-            int matches = sscanf(trimmed + 2, "%d/%d/%d %d/%d/%d %d/%d/%d", 
-                                 &p[0], &t[0], &n[0], &p[1], &t[1], &n[1], &p[2], &t[2], &n[2]);
 
-            if (matches != 9) {
-                printf("WARNING: Unsupported face format: %s. Only v/vt/vn is supported.\n", trimmed);
+            const obj_face_t* face = &faces[f];
+            if (face->corners) {
+                printf("WARNING: Unsupported face format: f %.*s. Only v/vt/vn is supported.\n",
+                       (int)(line_end_of(face->corners, end) - face->corners), face->corners);
+                continue;
+            }
+
+            bool in_range = true;
+            for (int i = 0; i < 3; i++) {
+                in_range &= face->p[i] >= 1 && face->p[i] <= counts.positions;
+                in_range &= face->t[i] >= 1 && face->t[i] <= counts.texcoords;
+                in_range &= face->n[i] >= 1 && face->n[i] <= counts.normals;
+            }
+            if (!in_range) {
+                printf("WARNING: load_obj: face index out of range, face skipped\n");
                 continue;
             }
 
             submesh_t* current_submesh = &mesh->submeshes[current_submesh_index];
             for (int i = 0; i < 3; i++) {
                 vertex_t vertex = {0};
-                vertex.position = temp_positions[p[i] - 1];
-                vertex.texcoord = temp_texcoords[t[i] - 1];
-                vertex.normal   = temp_normals[n[i] - 1];
+                vertex.position = positions[face->p[i] - 1];
+                vertex.texcoord = texcoords[face->t[i] - 1];
+                vertex.normal   = normals[face->n[i] - 1];
                 
-                u32 index = find_or_add_vertex(mesh, vertex);
+                u32 index = find_or_add_vertex(mesh, &vertex_table, vertex);
                 
                 array_push(current_submesh->indices, index);
                 current_submesh->index_count++;
             }
         }
+        array_free(chunk->events);
     }
 
-    fclose(file);
+    file_unmap(&file);
 
-    array_free(temp_positions);
-    array_free(temp_texcoords);
-    array_free(temp_normals);
+    free(vertex_table.slots);
+    free(positions);
+    free(texcoords);
+    free(normals);
+    free(faces);
     array_free(material_lookups);
 
+    // the material library and its textures are not part of the obj text
+    const double parse_seconds = seconds_now() - start_time - mtl_seconds;
+    const double megabytes = (double)file_size / (1024.0 * 1024.0);
+    printf("INFO: Parsed OBJ: %.2f MB in %.1f ms (%.0f MB/s)\n", megabytes, parse_seconds * 1000.0, megabytes / parse_seconds);
+
+    const float acmr = mesh_acmr(mesh);
+    if (mesh_optimize(mesh)) {
+        printf("INFO: Optimized OBJ vertex order: acmr %.3f -> %.3f (fifo of %d)\n", acmr, mesh_acmr(mesh), MESH_CACHE_SIZE);
+    }
+    mesh_compute_bounds(mesh);
+    mesh_build_meshlets(mesh);
+    mesh_build_lods(mesh);
+    mesh_build_streams(mesh);
+
+    if (!has_key || !mesh_cache_write(cache_path, &cache_key, mesh, cache_libraries, array_length(cache_libraries), cache_materials)) {
+        printf("WARNING: load_obj: could not write mesh cache %s\n", cache_path);
+    }
+    array_free(cache_libraries);
+    array_free(cache_materials);
+
     printf("INFO: Loaded OBJ: %d vertices, %d submeshes\n", mesh->vertex_count, mesh->submesh_count);
     for (int i = 0; i < mesh->submesh_count; i++) {
         printf("  - Submesh %d: material_id=%d, indices=%d\n", i, mesh->submeshes[i].material_id, mesh->submeshes[i].index_count);
@@ -157,24 +659,25 @@ void load_obj(const char* path, mesh_t* mesh, material_manager_t* m) {
 }
 
 int load_mtl(const char* mtl_path, const char* obj_dir, material_manager_t* m, material_lookup_t** lookup_table_out) {
-    FILE* file = fopen(mtl_path, "r");
-    if (!file) {
+    mapped_file_t file;
+    if (!file_map(mtl_path, &file)) {
         printf("ERROR: Cannot open MTL file: %s\n", mtl_path);
         return 0;
     }
+    const char* const end = file.data + file.size;
 
     material_lookup_t* lookups = NULL;
     material_t* current_material = NULL;
-    char line[1024];
 
-    while (fgets(line, sizeof(line), file)) {
-        char* trimmed = trim_whitespace(line);
-        if (strlen(trimmed) == 0 || trimmed[0] == '#') continue;
+    for (const char* line = file.data; line < end; ) {
+        const char* const line_end = line_end_of(line, end);
+        const char* c = skip_blanks(line, line_end);
+        line = line_end + 1;
+        if (c == line_end || *c == '#') continue;
 
-        if (strncmp(trimmed, "newmtl ", 7) == 0) {
+        if (match_keyword(&c, line_end, "newmtl")) {
             material_lookup_t new_lookup;
-            strncpy(new_lookup.name, trimmed + 7, sizeof(new_lookup.name) - 1);
-            new_lookup.name[sizeof(new_lookup.name) - 1] = '\0';
+            copy_rest_of_line(c, line_end, new_lookup.name, sizeof(new_lookup.name));
 
             int new_mat_id = m_create_material(m, new_lookup.name);
             new_lookup.material_id = new_mat_id;
@@ -183,45 +686,31 @@ int load_mtl(const char* mtl_path, const char* obj_dir, material_manager_t* m, m
             current_material = m_get_material(m, new_mat_id);
             printf("DEBUG: load_mtl: material: Found new material '%s' with ID %d\n", new_lookup.name, new_mat_id);
 
-        } else if (current_material && strncmp(trimmed, "Ka ", 3) == 0) {
-            sscanf(trimmed + 3, "%f %f %f", 
-                   &current_material->ambient.x, 
-                   &current_material->ambient.y, 
-                   &current_material->ambient.z);
+        } else if (current_material && match_keyword(&c, line_end, "Ka")) {
+            parse_vec3(&c, line_end, &current_material->ambient);
             printf("- DEBUG: load_mtl: material: Found ambient color\n");
-        } else if (current_material && strncmp(trimmed, "Kd ", 3) == 0) {
-            sscanf(trimmed + 3, "%f %f %f", 
-                   &current_material->diffuse.x, 
-                   &current_material->diffuse.y, 
-                   &current_material->diffuse.z);
+        } else if (current_material && match_keyword(&c, line_end, "Kd")) {
+            parse_vec3(&c, line_end, &current_material->diffuse);
             printf("- DEBUG: load_mtl: material: Found diffuse color\n");
-        } else if (current_material && strncmp(trimmed, "Ks ", 3) == 0) {
-            sscanf(trimmed + 3, "%f %f %f", 
-                   &current_material->specular.x, 
-                   &current_material->specular.y, 
-                   &current_material->specular.z);
+        } else if (current_material && match_keyword(&c, line_end, "Ks")) {
+            parse_vec3(&c, line_end, &current_material->specular);
             printf("- DEBUG: load_mtl: material: Found specular color\n");
-        } else if (current_material && strncmp(trimmed, "Ns ", 3) == 0) {
-            sscanf(trimmed + 3, "%f", &current_material->shininess);
+        } else if (current_material && match_keyword(&c, line_end, "Ns")) {
+            parse_float(&c, line_end, &current_material->shininess);
             printf("- DEBUG: load_mtl: material: Found shininess\n");
-        } else if (current_material && strncmp(trimmed, "map_Kd ", 7) == 0) {
+        } else if (current_material && match_keyword(&c, line_end, "map_Kd")) {
             printf("- DEBUG: load_mtl: material: Found diffuse texture map\n");
 
             char texture_filename[256];
-            strncpy(texture_filename, trimmed + 7, sizeof(texture_filename) - 1);
-            texture_filename[sizeof(texture_filename) - 1] = '\0';
+            copy_rest_of_line(c, line_end, texture_filename, sizeof(texture_filename));
 
             char texture_path[512];
             snprintf(texture_path, sizeof(texture_path), "%s%s", obj_dir, texture_filename);
             
-            int width, height, channels;
-            unsigned char* data = NULL;
-            m_parse_texture_file(texture_path, &width, &height, &channels, &data);
-
-            if (data) {
-                int texture_id = m_create_texture(m, width, height, channels, data);
+            int texture_id = m_load_texture(m, texture_path);
+            if (texture_id != -1) {
                 current_material->diffuse_map_id = texture_id;
-                if (texture_id != -1) m->texture_used[texture_id] = true;
+                m->texture_used[texture_id] = true;
                 printf("- DEBUG: load_mtl: material: created texture id=%d\n", texture_id);
             } else {
                 printf("- WARNING: load_mtl: material: Failed to load texture: %s\n", texture_path);
@@ -229,7 +718,7 @@ int load_mtl(const char* mtl_path, const char* obj_dir, material_manager_t* m, m
         }
     }
     printf("\n");
-    fclose(file);
+    file_unmap(&file);
     *lookup_table_out = lookups;
     return array_length(lookups);
 }
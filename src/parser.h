@@ -4,6 +4,7 @@
 #include "mesh.h"
 #include "c3m.h"
 #include "materials.h"
+#include "thread.h"
 #include "array.h"
 #include <stdio.h>
 #include <stdlib.h>
@@ -15,7 +16,8 @@ typedef struct {
     int material_id;
 } material_lookup_t;
 
-void load_obj(const char* path, mesh_t* mesh, material_manager_t* m);
+// pool may be NULL, the obj is then parsed on the calling thread
+void load_obj(const char* path, mesh_t* mesh, material_manager_t* m, worker_pool_t* pool);
 int load_mtl(const char* mtl_path, const char* obj_dir, material_manager_t* m, material_lookup_t** lookup_table_out);
 
 #endif // PARSER_H
\ No newline at end of file
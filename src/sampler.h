@@ -0,0 +1,359 @@
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+// texture sampling shared by the rasterizers and the visibility buffer resolve.
+// texel byte order is r, g, b, a, so channel i of a texel read as u32 is bits 8i..8i+7
+
+#include "materials.h"
+
+// level of detail from the screen-space derivatives of u and v: log2 of the
+// longer axis of the pixel footprint in base level texels, clamped to the chain.
+// log2 is approximated from the float bits, exact at powers of two
+static inline float texture_lod(const texture_t* t, float dudx, float dvdx, float dudy, float dvdy) {
+    const float w = (float)t->width;
+    const float h = (float)t->height;
+    const float len_x = dudx * dudx * w * w + dvdx * dvdx * h * h;
+    const float len_y = dudy * dudy * w * w + dvdy * dvdy * h * h;
+    union { float f; i32 i; } bits;
+    bits.f = (len_x > len_y) ? len_x : len_y;
+
+    float lod = 0.5f * ((float)bits.i * (1.0f / (1 << 23)) - 127.0f);
+    const float max_lod = (float)(t->level_count - 1);
+    lod = (lod > 0.0f) ? lod : 0.0f;
+    return (lod < max_lod) ? lod : max_lod;
+}
+
+// palette weight of endpoint 0 per index, the 4 color (/3) and 8 alpha (/7) variants
+#define TEXTURE_BC_COLOR_WEIGHTS 0x1203u
+#define TEXTURE_BC_ALPHA_WEIGHTS 0x12345607u
+
+static inline u32 texture_bc_expand_565(u32 c) {
+    const u32 r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+    return ((r << 3) | (r >> 2)) | ((g << 2) | (g >> 4)) << 8 | ((b << 3) | (b >> 2)) << 16;
+}
+
+// texel i of a bc1 color block as r, g, b with alpha 0
+static inline u32 texture_bc_decode_color(const u8* block, int i) {
+    u32 endpoints, indices;
+    memcpy(&endpoints, block, 4);
+    memcpy(&indices, block + 4, 4);
+    const u32 w0 = (TEXTURE_BC_COLOR_WEIGHTS >> (((indices >> (i * 2)) & 3) * 4)) & 0xF;
+    const u32 c0 = texture_bc_expand_565(endpoints & 0xFFFF);
+    const u32 c1 = texture_bc_expand_565(endpoints >> 16);
+
+    u32 texel = 0;
+    for (int shift = 0; shift < 24; shift += 8) {
+        texel |= ((w0 * ((c0 >> shift) & 0xFF) + (3 - w0) * ((c1 >> shift) & 0xFF)) / 3) << shift;
+    }
+    return texel;
+}
+
+// alpha of texel i of a bc3 alpha block
+static inline u32 texture_bc_decode_alpha(const u8* block, int i) {
+    u64 bits;
+    memcpy(&bits, block, 8);
+    const u32 w0 = (TEXTURE_BC_ALPHA_WEIGHTS >> (((bits >> (16 + i * 3)) & 7) * 4)) & 0xF;
+    return (w0 * (u32)(bits & 0xFF) + (7 - w0) * (u32)((bits >> 8) & 0xFF)) / 7;
+}
+
+// texel at a tiled index (level offset + tile row + tile column) in any format
+static inline u32 texture_fetch(const texture_t* t, int index) {
+    switch (t->format) {
+        case TEXTURE_BC1:
+            return texture_bc_decode_color(t->data + (size_t)(index >> 4) * 8, index & 15) | 0xff000000u;
+        case TEXTURE_BC3: {
+            const u8* block = t->data + (size_t)(index >> 4) * 16;
+            return texture_bc_decode_color(block + 8, index & 15) | texture_bc_decode_alpha(block, index & 15) << 24;
+        }
+        default:
+            return ((const u32*)t->data)[index];
+    }
+}
+
+// filtering blends texels with integer weights: bilinear fractions have
+// TEXTURE_FILTER_BITS bits, so the four weights are products that sum to
+// 1 << (2 * TEXTURE_FILTER_BITS) and fit the signed 16 bits pmaddwd takes
+#define TEXTURE_FILTER_BITS 7
+#define TEXTURE_FILTER_ONE (1 << TEXTURE_FILTER_BITS)
+#define TEXTURE_BLEND_SHIFT (2 * TEXTURE_FILTER_BITS)
+
+// weights are packed in pairs, (w10 << 16 | w00) for the top row and (w11 << 16 | w01)
+// for the bottom one. all four rgba channels are blended at once and rounded once
+static inline u32 texture_blend(u32 t00, u32 t10, u32 t01, u32 t11, u32 top, u32 bottom) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i row0 = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128((int)t00), zero), _mm_unpacklo_epi8(_mm_cvtsi32_si128((int)t10), zero));
+    const __m128i row1 = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128((int)t01), zero), _mm_unpacklo_epi8(_mm_cvtsi32_si128((int)t11), zero));
+    __m128i sum = _mm_add_epi32(_mm_madd_epi16(row0, _mm_set1_epi32((int)top)), _mm_madd_epi16(row1, _mm_set1_epi32((int)bottom)));
+    sum = _mm_srai_epi32(_mm_add_epi32(sum, _mm_set1_epi32(1 << (TEXTURE_BLEND_SHIFT - 1))), TEXTURE_BLEND_SHIFT);
+    return (u32)_mm_cvtsi128_si32(_mm_packus_epi16(_mm_packs_epi32(sum, zero), zero));
+}
+
+static inline u32 texture_sample_nearest(const texture_t* t, int level, float u, float v) {
+    const int tex_width = t->level_width[level];
+    const int tex_height = t->level_height[level];
+    const int tex_x = (int)(u * tex_width) & (tex_width - 1);
+    const int tex_y = (int)(v * tex_height) & (tex_height - 1);
+    return texture_fetch(t, t->level_offset[level] + texture_tile_row(tex_y, tex_width) + texture_tile_column(tex_x));
+}
+
+static inline u32 texture_sample_bilinear(const texture_t* t, int level, float u, float v) {
+    const int tex_width = t->level_width[level];
+    const int tex_height = t->level_height[level];
+    const int tex_width_mask = tex_width - 1;
+    const int tex_height_mask = tex_height - 1;
+
+    const float tex_u = u * tex_width;
+    const float tex_v = v * tex_height;
+    const int tex_x0 = ((int)tex_u) & tex_width_mask;
+    const int tex_y0 = ((int)tex_v) & tex_height_mask;
+    const int tex_x1 = (tex_x0 + 1) & tex_width_mask;
+    const int tex_y1 = (tex_y0 + 1) & tex_height_mask;
+    const u32 frac_u = (u32)((tex_u - floorf(tex_u)) * TEXTURE_FILTER_ONE);
+    const u32 frac_v = (u32)((tex_v - floorf(tex_v)) * TEXTURE_FILTER_ONE);
+    const int row0 = t->level_offset[level] + texture_tile_row(tex_y0, tex_width);
+    const int row1 = t->level_offset[level] + texture_tile_row(tex_y1, tex_width);
+    const int column0 = texture_tile_column(tex_x0);
+    const int column1 = texture_tile_column(tex_x1);
+    const u32 texel00 = texture_fetch(t, row0 + column0);
+    const u32 texel10 = texture_fetch(t, row0 + column1);
+    const u32 texel01 = texture_fetch(t, row1 + column0);
+    const u32 texel11 = texture_fetch(t, row1 + column1);
+    const u32 inv_frac_u = TEXTURE_FILTER_ONE - frac_u;
+    const u32 inv_frac_v = TEXTURE_FILTER_ONE - frac_v;
+    return texture_blend(texel00, texel10, texel01, texel11,
+                         (frac_u * inv_frac_v) << 16 | (inv_frac_u * inv_frac_v),
+                         (frac_u * frac_v) << 16 | (inv_frac_u * frac_v));
+}
+
+static inline u32 texture_sample_level(const texture_t* t, int level, float u, float v, bool bilinear) {
+    return bilinear ? texture_sample_bilinear(t, level, u, v) : texture_sample_nearest(t, level, u, v);
+}
+
+static inline u32 texture_sample(const texture_t* t, mipmap_mode_t mode, float lod, float u, float v, bool bilinear) {
+    if (mode == MIPMAP_NONE) return texture_sample_level(t, 0, u, v, bilinear);
+    if (mode == MIPMAP_NEAREST) return texture_sample_level(t, (int)(lod + 0.5f), u, v, bilinear);
+
+    const int level = (int)lod;
+    const float frac = lod - (float)level;
+    const u32 texel0 = texture_sample_level(t, level, u, v, bilinear);
+    if (level + 1 >= t->level_count || frac == 0.0f) return texel0;
+    const u32 texel1 = texture_sample_level(t, level + 1, u, v, bilinear);
+
+    const u32 weight = (u32)(frac * (1 << TEXTURE_BLEND_SHIFT));
+    return texture_blend(texel0, texel1, 0, 0, weight << 16 | ((1 << TEXTURE_BLEND_SHIFT) - weight), 0);
+}
+
+#if defined(__AVX2__) && defined(__FMA__)
+
+// per-lane size and position of the sampled mip level
+typedef struct {
+    __m256i width;
+    __m256i height;
+    __m256i offset;
+} simd_level_t;
+
+static inline simd_level_t simd_level_base(const texture_t* texture) {
+    simd_level_t l;
+    l.width = _mm256_set1_epi32(texture->width);
+    l.height = _mm256_set1_epi32(texture->height);
+    l.offset = _mm256_setzero_si256();
+    return l;
+}
+
+static inline simd_level_t simd_level_gather(const texture_t* texture, __m256i level) {
+    simd_level_t l;
+    l.width = _mm256_i32gather_epi32((const int*)texture->level_width, level, 4);
+    l.height = _mm256_i32gather_epi32((const int*)texture->level_height, level, 4);
+    l.offset = _mm256_i32gather_epi32((const int*)texture->level_offset, level, 4);
+    return l;
+}
+
+// 8-wide texture_tile_row and texture_tile_column
+static inline __m256i simd_tile_row(__m256i y, const simd_level_t* l) {
+    const __m256i tiles_x = _mm256_srli_epi32(_mm256_add_epi32(l->width, _mm256_set1_epi32(TEXTURE_TILE_MASK)), TEXTURE_TILE_SHIFT);
+    const __m256i tile = _mm256_mullo_epi32(_mm256_srli_epi32(y, TEXTURE_TILE_SHIFT), tiles_x);
+    return _mm256_add_epi32(_mm256_slli_epi32(tile, 2 * TEXTURE_TILE_SHIFT),
+                            _mm256_slli_epi32(_mm256_and_si256(y, _mm256_set1_epi32(TEXTURE_TILE_MASK)), TEXTURE_TILE_SHIFT));
+}
+
+static inline __m256i simd_tile_column(__m256i x) {
+    return _mm256_add_epi32(_mm256_slli_epi32(_mm256_srli_epi32(x, TEXTURE_TILE_SHIFT), 2 * TEXTURE_TILE_SHIFT),
+                            _mm256_and_si256(x, _mm256_set1_epi32(TEXTURE_TILE_MASK)));
+}
+
+static inline __m256i simd_bc_expand_565(__m256i c) {
+    const __m256i r = _mm256_and_si256(_mm256_srli_epi32(c, 11), _mm256_set1_epi32(31));
+    const __m256i g = _mm256_and_si256(_mm256_srli_epi32(c, 5), _mm256_set1_epi32(63));
+    const __m256i b = _mm256_and_si256(c, _mm256_set1_epi32(31));
+    return _mm256_or_si256(_mm256_or_si256(_mm256_slli_epi32(r, 3), _mm256_srli_epi32(r, 2)),
+           _mm256_or_si256(_mm256_slli_epi32(_mm256_or_si256(_mm256_slli_epi32(g, 2), _mm256_srli_epi32(g, 4)), 8),
+                           _mm256_slli_epi32(_mm256_or_si256(_mm256_slli_epi32(b, 3), _mm256_srli_epi32(b, 2)), 16)));
+}
+
+// 8-wide texture_bc_decode_color, base is the byte offset of each lane's color block.
+// x / 3 is (x * 43691) >> 17 and x / 7 is (x * 37450) >> 18, exact over the ranges used
+static inline __m256i simd_bc_decode_color(const u8* data, __m256i base, __m256i i) {
+    const __m256i endpoints = _mm256_i32gather_epi32((const int*)data, base, 1);
+    const __m256i indices = _mm256_i32gather_epi32((const int*)data, _mm256_add_epi32(base, _mm256_set1_epi32(4)), 1);
+    const __m256i select = _mm256_and_si256(_mm256_srlv_epi32(indices, _mm256_add_epi32(i, i)), _mm256_set1_epi32(3));
+    const __m256i w0 = _mm256_permutevar8x32_epi32(_mm256_setr_epi32(3, 0, 2, 1, 0, 0, 0, 0), select);
+    const __m256i w1 = _mm256_sub_epi32(_mm256_set1_epi32(3), w0);
+    const __m256i c0 = simd_bc_expand_565(_mm256_and_si256(endpoints, _mm256_set1_epi32(0xFFFF)));
+    const __m256i c1 = simd_bc_expand_565(_mm256_srli_epi32(endpoints, 16));
+
+    __m256i texel = _mm256_setzero_si256();
+    for (int shift = 0; shift < 24; shift += 8) {
+        const __m256i channel = _mm256_set1_epi32(0xFF);
+        const __m256i sum = _mm256_add_epi32(_mm256_mullo_epi32(w0, _mm256_and_si256(_mm256_srli_epi32(c0, shift), channel)),
+                                             _mm256_mullo_epi32(w1, _mm256_and_si256(_mm256_srli_epi32(c1, shift), channel)));
+        texel = _mm256_or_si256(texel, _mm256_slli_epi32(_mm256_srli_epi32(_mm256_mullo_epi32(sum, _mm256_set1_epi32(43691)), 17), shift));
+    }
+    return texel;
+}
+
+// 8-wide texture_bc_decode_alpha, the 3 bit index is read from the dword at its byte
+static inline __m256i simd_bc_decode_alpha(const u8* data, __m256i base, __m256i i) {
+    const __m256i endpoints = _mm256_i32gather_epi32((const int*)data, base, 1);
+    const __m256i bit = _mm256_add_epi32(_mm256_set1_epi32(16), _mm256_add_epi32(i, _mm256_add_epi32(i, i)));
+    const __m256i bits = _mm256_i32gather_epi32((const int*)data, _mm256_add_epi32(base, _mm256_srli_epi32(bit, 3)), 1);
+    const __m256i select = _mm256_and_si256(_mm256_srlv_epi32(bits, _mm256_and_si256(bit, _mm256_set1_epi32(7))), _mm256_set1_epi32(7));
+    const __m256i w0 = _mm256_permutevar8x32_epi32(_mm256_setr_epi32(7, 0, 6, 5, 4, 3, 2, 1), select);
+    const __m256i w1 = _mm256_sub_epi32(_mm256_set1_epi32(7), w0);
+    const __m256i a0 = _mm256_and_si256(endpoints, _mm256_set1_epi32(0xFF));
+    const __m256i a1 = _mm256_and_si256(_mm256_srli_epi32(endpoints, 8), _mm256_set1_epi32(0xFF));
+    const __m256i sum = _mm256_add_epi32(_mm256_mullo_epi32(w0, a0), _mm256_mullo_epi32(w1, a1));
+    return _mm256_srli_epi32(_mm256_mullo_epi32(sum, _mm256_set1_epi32(37450)), 18);
+}
+
+// 8-wide texture_fetch
+static inline __m256i simd_fetch(const texture_t* texture, __m256i index) {
+    if (texture->format == TEXTURE_RGBA8) {
+        return _mm256_i32gather_epi32((const int*)texture->data, index, 4);
+    }
+
+    const __m256i block = _mm256_srli_epi32(index, 4);
+    const __m256i i = _mm256_and_si256(index, _mm256_set1_epi32(15));
+    if (texture->format == TEXTURE_BC1) {
+        return _mm256_or_si256(simd_bc_decode_color(texture->data, _mm256_slli_epi32(block, 3), i), _mm256_set1_epi32((int)0xff000000u));
+    }
+    const __m256i base = _mm256_slli_epi32(block, 4);
+    return _mm256_or_si256(simd_bc_decode_color(texture->data, _mm256_add_epi32(base, _mm256_set1_epi32(8)), i),
+                           _mm256_slli_epi32(simd_bc_decode_alpha(texture->data, base, i), 24));
+}
+
+// 8-wide texture_blend, one pair of top and bottom weights per lane. pmaddwd
+// works on 128 bit halves, so the texels are widened two pixels at a time
+// and pixel k of each half gets its weights broadcast with a shuffle
+static inline __m256i simd_blend(__m256i t00, __m256i t10, __m256i t01, __m256i t11, __m256i top, __m256i bottom) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i round = _mm256_set1_epi32(1 << (TEXTURE_BLEND_SHIFT - 1));
+    const __m256i t00_lo = _mm256_unpacklo_epi8(t00, zero), t00_hi = _mm256_unpackhi_epi8(t00, zero);
+    const __m256i t10_lo = _mm256_unpacklo_epi8(t10, zero), t10_hi = _mm256_unpackhi_epi8(t10, zero);
+    const __m256i t01_lo = _mm256_unpacklo_epi8(t01, zero), t01_hi = _mm256_unpackhi_epi8(t01, zero);
+    const __m256i t11_lo = _mm256_unpacklo_epi8(t11, zero), t11_hi = _mm256_unpackhi_epi8(t11, zero);
+
+#define SIMD_BLEND_PIXEL(unpack, half, k) \
+    _mm256_srai_epi32(_mm256_add_epi32(_mm256_add_epi32( \
+        _mm256_madd_epi16(unpack(t00_##half, t10_##half), _mm256_shuffle_epi32(top, k * 0x55)), \
+        _mm256_madd_epi16(unpack(t01_##half, t11_##half), _mm256_shuffle_epi32(bottom, k * 0x55))), round), TEXTURE_BLEND_SHIFT)
+
+    const __m256i p0 = SIMD_BLEND_PIXEL(_mm256_unpacklo_epi16, lo, 0);
+    const __m256i p1 = SIMD_BLEND_PIXEL(_mm256_unpackhi_epi16, lo, 1);
+    const __m256i p2 = SIMD_BLEND_PIXEL(_mm256_unpacklo_epi16, hi, 2);
+    const __m256i p3 = SIMD_BLEND_PIXEL(_mm256_unpackhi_epi16, hi, 3);
+#undef SIMD_BLEND_PIXEL
+
+    return _mm256_packus_epi16(_mm256_packs_epi32(p0, p1), _mm256_packs_epi32(p2, p3));
+}
+
+// 8-wide texture_lod, lanes with garbage derivatives end up at level 0
+static inline __m256 simd_texture_lod(const texture_t* texture, __m256 dudx, __m256 dvdx, __m256 dudy, __m256 dvdy) {
+    const __m256 w2 = _mm256_set1_ps((float)texture->width * (float)texture->width);
+    const __m256 h2 = _mm256_set1_ps((float)texture->height * (float)texture->height);
+    const __m256 len_x = _mm256_fmadd_ps(_mm256_mul_ps(dudx, dudx), w2, _mm256_mul_ps(_mm256_mul_ps(dvdx, dvdx), h2));
+    const __m256 len_y = _mm256_fmadd_ps(_mm256_mul_ps(dudy, dudy), w2, _mm256_mul_ps(_mm256_mul_ps(dvdy, dvdy), h2));
+    const __m256 bits = _mm256_cvtepi32_ps(_mm256_castps_si256(_mm256_max_ps(len_x, len_y)));
+    const __m256 lod = _mm256_mul_ps(_mm256_set1_ps(0.5f), _mm256_fmsub_ps(bits, _mm256_set1_ps(1.0f / (1 << 23)), _mm256_set1_ps(127.0f)));
+    return _mm256_min_ps(_mm256_max_ps(lod, _mm256_setzero_ps()), _mm256_set1_ps((float)(texture->level_count - 1)));
+}
+
+static inline __m256i simd_sample_nearest(const texture_t* texture, const simd_level_t* l, __m256 u, __m256 v) {
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256i tex_x = _mm256_and_si256(_mm256_cvttps_epi32(_mm256_mul_ps(u, _mm256_cvtepi32_ps(l->width))),  _mm256_sub_epi32(l->width, one));
+    const __m256i tex_y = _mm256_and_si256(_mm256_cvttps_epi32(_mm256_mul_ps(v, _mm256_cvtepi32_ps(l->height))), _mm256_sub_epi32(l->height, one));
+    const __m256i index = _mm256_add_epi32(_mm256_add_epi32(simd_tile_row(tex_y, l), simd_tile_column(tex_x)), l->offset);
+    return simd_fetch(texture, index);
+}
+
+static inline __m256i simd_sample_bilinear(const texture_t* texture, const simd_level_t* l, __m256 u, __m256 v) {
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256i width_mask = _mm256_sub_epi32(l->width, one);
+    const __m256i height_mask = _mm256_sub_epi32(l->height, one);
+
+    const __m256 tex_u = _mm256_mul_ps(u, _mm256_cvtepi32_ps(l->width));
+    const __m256 tex_v = _mm256_mul_ps(v, _mm256_cvtepi32_ps(l->height));
+    const __m256i tex_x0 = _mm256_and_si256(_mm256_cvttps_epi32(tex_u), width_mask);
+    const __m256i tex_y0 = _mm256_and_si256(_mm256_cvttps_epi32(tex_v), height_mask);
+    const __m256i tex_x1 = _mm256_and_si256(_mm256_add_epi32(tex_x0, one), width_mask);
+    const __m256i tex_y1 = _mm256_and_si256(_mm256_add_epi32(tex_y0, one), height_mask);
+    const __m256 filter_one = _mm256_set1_ps((float)TEXTURE_FILTER_ONE);
+    const __m256i frac_u = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_sub_ps(tex_u, _mm256_floor_ps(tex_u)), filter_one));
+    const __m256i frac_v = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_sub_ps(tex_v, _mm256_floor_ps(tex_v)), filter_one));
+    const __m256i inv_frac_u = _mm256_sub_epi32(_mm256_set1_epi32(TEXTURE_FILTER_ONE), frac_u);
+    const __m256i inv_frac_v = _mm256_sub_epi32(_mm256_set1_epi32(TEXTURE_FILTER_ONE), frac_v);
+
+    const __m256i row0 = _mm256_add_epi32(simd_tile_row(tex_y0, l), l->offset);
+    const __m256i row1 = _mm256_add_epi32(simd_tile_row(tex_y1, l), l->offset);
+    const __m256i column0 = simd_tile_column(tex_x0);
+    const __m256i column1 = simd_tile_column(tex_x1);
+    const __m256i texel00 = simd_fetch(texture, _mm256_add_epi32(row0, column0));
+    const __m256i texel10 = simd_fetch(texture, _mm256_add_epi32(row0, column1));
+    const __m256i texel01 = simd_fetch(texture, _mm256_add_epi32(row1, column0));
+    const __m256i texel11 = simd_fetch(texture, _mm256_add_epi32(row1, column1));
+
+    const __m256i top = _mm256_or_si256(_mm256_slli_epi32(_mm256_mullo_epi32(frac_u, inv_frac_v), 16), _mm256_mullo_epi32(inv_frac_u, inv_frac_v));
+    const __m256i bottom = _mm256_or_si256(_mm256_slli_epi32(_mm256_mullo_epi32(frac_u, frac_v), 16), _mm256_mullo_epi32(inv_frac_u, frac_v));
+    return simd_blend(texel00, texel10, texel01, texel11, top, bottom);
+}
+
+static inline __m256i simd_sample_level(const texture_t* texture, const simd_level_t* l, __m256 u, __m256 v, bool bilinear) {
+    return bilinear ? simd_sample_bilinear(texture, l, u, v) : simd_sample_nearest(texture, l, u, v);
+}
+
+// 8-wide texture_sample, lod is only read when mode is not MIPMAP_NONE
+static inline __m256i simd_sample(const texture_t* texture, mipmap_mode_t mode, __m256 lod, __m256 u, __m256 v, bool bilinear) {
+    if (mode == MIPMAP_NONE) {
+        const simd_level_t base = simd_level_base(texture);
+        return simd_sample_level(texture, &base, u, v, bilinear);
+    }
+    if (mode == MIPMAP_NEAREST) {
+        const simd_level_t l = simd_level_gather(texture, _mm256_cvttps_epi32(_mm256_add_ps(lod, _mm256_set1_ps(0.5f))));
+        return simd_sample_level(texture, &l, u, v, bilinear);
+    }
+
+    const __m256i level = _mm256_cvttps_epi32(lod);
+    const __m256 frac = _mm256_sub_ps(lod, _mm256_cvtepi32_ps(level));
+    const __m256i next = _mm256_min_epi32(_mm256_add_epi32(level, _mm256_set1_epi32(1)), _mm256_set1_epi32(texture->level_count - 1));
+    const simd_level_t l0 = simd_level_gather(texture, level);
+    const simd_level_t l1 = simd_level_gather(texture, next);
+    const __m256i texel0 = simd_sample_level(texture, &l0, u, v, bilinear);
+    const __m256i texel1 = simd_sample_level(texture, &l1, u, v, bilinear);
+
+    const __m256i weight = _mm256_cvttps_epi32(_mm256_mul_ps(frac, _mm256_set1_ps((float)(1 << TEXTURE_BLEND_SHIFT))));
+    const __m256i top = _mm256_or_si256(_mm256_slli_epi32(weight, 16), _mm256_sub_epi32(_mm256_set1_epi32(1 << TEXTURE_BLEND_SHIFT), weight));
+    const __m256i zero = _mm256_setzero_si256();
+    return simd_blend(texel0, texel1, zero, zero, top, zero);
+}
+
+static inline __m256i simd_clamp_u8(__m256i v) {
+    return _mm256_min_epi32(_mm256_max_epi32(v, _mm256_setzero_si256()), _mm256_set1_epi32(255));
+}
+
+static inline __m256i simd_pack_rgb(__m256i r, __m256i g, __m256i b) {
+    return _mm256_or_si256(_mm256_or_si256(_mm256_set1_epi32((int)0xff000000u), _mm256_slli_epi32(r, 16)),
+                           _mm256_or_si256(_mm256_slli_epi32(g, 8), b));
+}
+
+#endif // __AVX2__ && __FMA__
+
+#endif // SAMPLER_H
@@ -0,0 +1,231 @@
+#define _DEFAULT_SOURCE // for sysconf(_SC_NPROCESSORS_ONLN)
+#include "thread.h"
+#include <stdio.h>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+typedef struct {
+    thread_fn fn;
+    void* arg;
+} thread_start_t;
+
+#ifdef _WIN32
+static DWORD WINAPI thread_trampoline(LPVOID param) {
+    thread_start_t start = *(thread_start_t*)param;
+    free(param);
+    start.fn(start.arg);
+    return 0;
+}
+#else
+static void* thread_trampoline(void* param) {
+    thread_start_t start = *(thread_start_t*)param;
+    free(param);
+    start.fn(start.arg);
+    return NULL;
+}
+#endif
+
+bool thread_create(thread_t* thread, thread_fn fn, void* arg) {
+    thread_start_t* start = malloc(sizeof(thread_start_t));
+    if (!start) return false;
+    start->fn = fn;
+    start->arg = arg;
+
+#ifdef _WIN32
+    *thread = CreateThread(NULL, 0, thread_trampoline, start, 0, NULL);
+    if (*thread == NULL) {
+        free(start);
+        return false;
+    }
+#else
+    if (pthread_create(thread, NULL, thread_trampoline, start) != 0) {
+        free(start);
+        return false;
+    }
+#endif
+    return true;
+}
+
+void thread_join(thread_t thread) {
+#ifdef _WIN32
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+#else
+    pthread_join(thread, NULL);
+#endif
+}
+
+int thread_cpu_count(void) {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    int count = (int)info.dwNumberOfProcessors;
+#else
+    int count = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    return (count < 1) ? 1 : count;
+}
+
+void mutex_init(mutex_t* mutex) {
+#ifdef _WIN32
+    InitializeCriticalSection(mutex);
+#else
+    pthread_mutex_init(mutex, NULL);
+#endif
+}
+
+void mutex_destroy(mutex_t* mutex) {
+#ifdef _WIN32
+    DeleteCriticalSection(mutex);
+#else
+    pthread_mutex_destroy(mutex);
+#endif
+}
+
+void mutex_lock(mutex_t* mutex) {
+#ifdef _WIN32
+    EnterCriticalSection(mutex);
+#else
+    pthread_mutex_lock(mutex);
+#endif
+}
+
+void mutex_unlock(mutex_t* mutex) {
+#ifdef _WIN32
+    LeaveCriticalSection(mutex);
+#else
+    pthread_mutex_unlock(mutex);
+#endif
+}
+
+void cond_init(cond_t* cond) {
+#ifdef _WIN32
+    InitializeConditionVariable(cond);
+#else
+    pthread_cond_init(cond, NULL);
+#endif
+}
+
+void cond_destroy(cond_t* cond) {
+#ifdef _WIN32
+    (void)cond; // nothing to release
+#else
+    pthread_cond_destroy(cond);
+#endif
+}
+
+void cond_wait(cond_t* cond, mutex_t* mutex) {
+#ifdef _WIN32
+    SleepConditionVariableCS(cond, mutex, INFINITE);
+#else
+    pthread_cond_wait(cond, mutex);
+#endif
+}
+
+void cond_broadcast(cond_t* cond) {
+#ifdef _WIN32
+    WakeAllConditionVariable(cond);
+#else
+    pthread_cond_broadcast(cond);
+#endif
+}
+
+// grabs tasks until none are left, each task is handed out exactly once per run
+static void pool_work(worker_pool_t* pool) {
+    while (true) {
+        mutex_lock(&pool->lock);
+        int task = pool->next_task++;
+        mutex_unlock(&pool->lock);
+
+        if (task >= pool->task_count) break;
+        pool->fn(pool->arg, task);
+    }
+}
+
+static void pool_worker(void* arg) {
+    worker_pool_t* pool = arg;
+    u32 seen = 0;
+
+    mutex_lock(&pool->lock);
+    while (true) {
+        while (pool->generation == seen && !pool->quit) cond_wait(&pool->wake, &pool->lock);
+        if (pool->quit) break;
+        seen = pool->generation;
+        mutex_unlock(&pool->lock);
+
+        pool_work(pool);
+
+        mutex_lock(&pool->lock);
+        if (--pool->busy == 0) cond_broadcast(&pool->done);
+    }
+    mutex_unlock(&pool->lock);
+}
+
+worker_pool_t* pool_create(int thread_count) {
+    worker_pool_t* pool = calloc(1, sizeof(worker_pool_t));
+    if (!pool) return NULL;
+
+    mutex_init(&pool->lock);
+    cond_init(&pool->wake);
+    cond_init(&pool->done);
+
+    // the thread calling pool_run works on tasks too
+    int workers = thread_count - 1;
+    if (workers > 0) pool->workers = malloc(workers * sizeof(thread_t));
+    for (int i = 0; i < workers && pool->workers; i++) {
+        if (!thread_create(&pool->workers[pool->worker_count], pool_worker, pool)) {
+            printf("WARNING: pool_create: could only start %d of %d worker threads\n", pool->worker_count, workers);
+            break;
+        }
+        pool->worker_count++;
+    }
+
+    return pool;
+}
+
+void pool_destroy(worker_pool_t* pool) {
+    if (!pool) return;
+
+    mutex_lock(&pool->lock);
+    pool->quit = true;
+    cond_broadcast(&pool->wake);
+    mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < pool->worker_count; i++) thread_join(pool->workers[i]);
+    free(pool->workers);
+
+    cond_destroy(&pool->done);
+    cond_destroy(&pool->wake);
+    mutex_destroy(&pool->lock);
+    free(pool);
+}
+
+int pool_thread_count(const worker_pool_t* pool) {
+    return pool ? pool->worker_count + 1 : 1;
+}
+
+// without a pool the tasks run one after another on the calling thread
+void pool_run(worker_pool_t* pool, pool_task_fn fn, void* arg, int task_count) {
+    if (!pool || pool->worker_count == 0) {
+        for (int i = 0; i < task_count; i++) fn(arg, i);
+        return;
+    }
+
+    mutex_lock(&pool->lock);
+    pool->fn = fn;
+    pool->arg = arg;
+    pool->task_count = task_count;
+    pool->next_task = 0;
+    pool->busy = pool->worker_count;
+    pool->generation++;
+    cond_broadcast(&pool->wake);
+    mutex_unlock(&pool->lock);
+
+    pool_work(pool);
+
+    mutex_lock(&pool->lock);
+    while (pool->busy > 0) cond_wait(&pool->done, &pool->lock);
+    mutex_unlock(&pool->lock);
+}
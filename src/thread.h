@@ -0,0 +1,62 @@
+#ifndef THREAD_H
+#define THREAD_H
+
+// minimal threading layer, pthreads on linux and win32 threads on windows
+
+#include "c3m.h"
+
+#ifdef _WIN32
+#include <windows.h>
+typedef HANDLE             thread_t;
+typedef CRITICAL_SECTION   mutex_t;
+typedef CONDITION_VARIABLE cond_t;
+#else
+#include <pthread.h>
+typedef pthread_t       thread_t;
+typedef pthread_mutex_t mutex_t;
+typedef pthread_cond_t  cond_t;
+#endif
+
+typedef void (*thread_fn)(void* arg);
+
+bool thread_create(thread_t* thread, thread_fn fn, void* arg);
+void thread_join(thread_t thread);
+int  thread_cpu_count(void);
+
+void mutex_init(mutex_t* mutex);
+void mutex_destroy(mutex_t* mutex);
+void mutex_lock(mutex_t* mutex);
+void mutex_unlock(mutex_t* mutex);
+
+void cond_init(cond_t* cond);
+void cond_destroy(cond_t* cond);
+void cond_wait(cond_t* cond, mutex_t* mutex);
+void cond_broadcast(cond_t* cond);
+
+// fixed set of worker threads running numbered tasks, the thread calling
+// pool_run works along until every task is done
+typedef void (*pool_task_fn)(void* arg, int task);
+
+typedef struct worker_pool {
+    thread_t* workers;
+    int worker_count;
+
+    pool_task_fn fn; // task being run
+    void* arg;
+    int task_count;
+
+    mutex_t lock;
+    cond_t wake;
+    cond_t done;
+    u32 generation;
+    int next_task;
+    int busy;
+    bool quit;
+} worker_pool_t;
+
+worker_pool_t* pool_create(int thread_count);
+void pool_destroy(worker_pool_t* pool);
+int  pool_thread_count(const worker_pool_t* pool);
+void pool_run(worker_pool_t* pool, pool_task_fn fn, void* arg, int task_count);
+
+#endif // THREAD_H
@@ -0,0 +1,112 @@
+#include "tiles.h"
+#include "array.h"
+
+static void tiles_rect(tile_renderer_t* tr, int tile, raster_rect_t* rect) {
+    const framebuffer_t* fb = &tr->ctx->framebuffer;
+    const int tx = tile % tr->tiles_x;
+    const int ty = tile / tr->tiles_x;
+
+    rect->min_x = tx * TILE_SIZE;
+    rect->min_y = ty * TILE_SIZE;
+    rect->max_x = rect->min_x + TILE_SIZE - 1;
+    rect->max_y = rect->min_y + TILE_SIZE - 1;
+    if (rect->max_x >= fb->width)  rect->max_x = fb->width - 1;
+    if (rect->max_y >= fb->height) rect->max_y = fb->height - 1;
+}
+
+static void tiles_rasterize_tile(tile_renderer_t* tr, int tile) {
+    render_context* ctx = tr->ctx;
+
+    raster_rect_t rect;
+    tiles_rect(tr, tile, &rect);
+
+    u32* bin = tr->bins[tile];
+    const int count = array_length(bin);
+    for (int i = 0; i < count; i++) {
+        const raster_triangle_t* t = &tr->triangles[bin[i]];
+        t->rasterize(ctx, t->texture, &rect,
+                     t->v[0].x, t->v[0].y, t->v[0].w, t->v[0].u, t->v[0].v, t->v[0].c,
+                     t->v[1].x, t->v[1].y, t->v[1].w, t->v[1].u, t->v[1].v, t->v[1].c,
+                     t->v[2].x, t->v[2].y, t->v[2].w, t->v[2].u, t->v[2].v, t->v[2].c);
+    }
+}
+
+// one task of the pool, tiles are handed out exactly once per flush
+static void tiles_task(void* arg, int tile) {
+    tile_renderer_t* tr = arg;
+    if (tr->job) {
+        raster_rect_t rect;
+        tiles_rect(tr, tile, &rect);
+        tr->job(tr->ctx, &rect);
+        return;
+    }
+    if (array_length(tr->bins[tile]) == 0) return;
+    tiles_rasterize_tile(tr, tile);
+}
+
+tile_renderer_t* tiles_create(int width, int height, worker_pool_t* pool) {
+    tile_renderer_t* tr = calloc(1, sizeof(tile_renderer_t));
+    if (!tr) return NULL;
+
+    tr->tiles_x = (width  + TILE_SIZE - 1) / TILE_SIZE;
+    tr->tiles_y = (height + TILE_SIZE - 1) / TILE_SIZE;
+    tr->tile_count = tr->tiles_x * tr->tiles_y;
+    tr->bins = calloc(tr->tile_count, sizeof(u32*));
+    tr->pool = pool;
+
+    return tr;
+}
+
+void tiles_destroy(tile_renderer_t* tr) {
+    if (!tr) return;
+
+    for (int i = 0; i < tr->tile_count; i++) array_free(tr->bins[i]);
+    free(tr->bins);
+    array_free(tr->triangles);
+    free(tr);
+}
+
+void tiles_bin_triangle(tile_renderer_t* tr, const framebuffer_t* fb, const raster_triangle_t* tri) {
+    // same bounds the rasterizer computes, so a triangle lands in every tile it can write to
+    const float x0 = tri->v[0].x, x1 = tri->v[1].x, x2 = tri->v[2].x;
+    const float y0 = tri->v[0].y, y1 = tri->v[1].y, y2 = tri->v[2].y;
+    int min_x = (int) floorf(fmin(fmin(x0, x1), x2));
+    int min_y = (int) floorf(fmin(fmin(y0, y1), y2));
+    int max_x = (int)  ceilf(fmax(fmax(x0, x1), x2));
+    int max_y = (int)  ceilf(fmax(fmax(y0, y1), y2));
+
+    if (min_x < 0) min_x = 0;
+    if (min_y < 0) min_y = 0;
+    if (max_x >= fb->width)  max_x = fb->width - 1;
+    if (max_y >= fb->height) max_y = fb->height - 1;
+    if (min_x > max_x || min_y > max_y) return;
+
+    u32 index = array_length(tr->triangles);
+    array_push(tr->triangles, *tri);
+
+    for (int ty = min_y / TILE_SIZE; ty <= max_y / TILE_SIZE; ty++) {
+        for (int tx = min_x / TILE_SIZE; tx <= max_x / TILE_SIZE; tx++) {
+            array_push(tr->bins[ty * tr->tiles_x + tx], index);
+        }
+    }
+}
+
+// one pass over all tiles on the pool, returns when every tile is done
+static void tiles_run_all(tile_renderer_t* tr, render_context* ctx, tile_job_t job) {
+    tr->ctx = ctx;
+    tr->job = job;
+    pool_run(tr->pool, tiles_task, tr, tr->tile_count);
+}
+
+void tiles_flush(tile_renderer_t* tr, render_context* ctx) {
+    if (array_length(tr->triangles) == 0) return;
+
+    tiles_run_all(tr, ctx, NULL);
+
+    array_clear(tr->triangles);
+    for (int i = 0; i < tr->tile_count; i++) array_clear(tr->bins[i]);
+}
+
+void tiles_dispatch(tile_renderer_t* tr, render_context* ctx, tile_job_t job) {
+    tiles_run_all(tr, ctx, job);
+}
@@ -0,0 +1,48 @@
+#ifndef TILES_H
+#define TILES_H
+
+// sort-middle tiled rasterization: triangles are binned into screen tiles
+// and a pool of worker threads rasterizes whole tiles, so every pixel of the
+// framebuffer is only ever touched by the thread that owns its tile
+
+#include "graphics.h"
+#include "thread.h"
+
+#define TILE_SIZE 64 // must be a power of two
+
+typedef struct {
+    float x, y, w;
+    float u, v;
+    u32 c;
+} raster_vertex_t;
+
+typedef struct {
+    rasterizer_t rasterize;
+    texture_t* texture;
+    raster_vertex_t v[3];
+} raster_triangle_t;
+
+// work run once per tile by tiles_dispatch, on whichever thread owns the tile
+typedef void (*tile_job_t)(render_context* ctx, const raster_rect_t* rect);
+
+typedef struct tile_renderer {
+    int tiles_x, tiles_y;
+    int tile_count;
+
+    raster_triangle_t* triangles; // dynamic array, submission order
+    u32** bins;                   // one dynamic array of triangle indices per tile
+
+    render_context* ctx;          // context being flushed
+    tile_job_t job;               // NULL when rasterizing the bins
+
+    worker_pool_t* pool;          // not owned, runs one task per tile
+} tile_renderer_t;
+
+tile_renderer_t* tiles_create(int width, int height, worker_pool_t* pool);
+void tiles_destroy(tile_renderer_t* tr);
+
+void tiles_bin_triangle(tile_renderer_t* tr, const framebuffer_t* fb, const raster_triangle_t* tri);
+void tiles_flush(tile_renderer_t* tr, render_context* ctx);
+void tiles_dispatch(tile_renderer_t* tr, render_context* ctx, tile_job_t job);
+
+#endif // TILES_H
@@ -1,36 +1,65 @@
+// RASTER_VISIBILITY: depth-only pass of the visibility buffer, the triangle id
+// passed in c0 is written to the id buffer instead of a shaded color
+#ifndef RASTER_VISIBILITY
+#define RASTER_VISIBILITY 0
+#endif
+
+#include "sampler.h"
+
 #define SWAP_F(a, b) do { float t = a; a = b; b = t; } while (0)
 #define SWAP_U32(a, b) do { u32 t = a; a = b; b = t; } while (0)
+#define SWAP_I32(a, b) do { i32 t = a; a = b; b = t; } while (0)
 
 void RASTERIZER_NAME(
-        render_context *ctx,
+        render_context *ctx, texture_t *texture, const raster_rect_t *clip,
         float x0, float y0, float w0, float u0, float v0, u32 c0,
         float x1, float y1, float w1, float u1, float v1, u32 c1,
         float x2, float y2, float w2, float u2, float v2, u32 c2) {
 
-    float area = ((x2 - x0) * (y1 - y0)) - ((y2 - y0) * (x1 - x0));
-    if (area < 0) {
-        area = -area;
-        SWAP_F(x1,x2);
-        SWAP_F(y1,y2);
+    // snap to the subpixel grid, coverage is decided on these exact positions
+    const float subpixel = (float)(1 << RASTER_SUBPIXEL_BITS);
+    i32 x0_fixed = (i32)lrintf(x0 * subpixel);
+    i32 y0_fixed = (i32)lrintf(y0 * subpixel);
+    i32 x1_fixed = (i32)lrintf(x1 * subpixel);
+    i32 y1_fixed = (i32)lrintf(y1 * subpixel);
+    i32 x2_fixed = (i32)lrintf(x2 * subpixel);
+    i32 y2_fixed = (i32)lrintf(y2 * subpixel);
+
+    i64 area_fixed = (i64)(x2_fixed - x0_fixed) * (y1_fixed - y0_fixed) - (i64)(y2_fixed - y0_fixed) * (x1_fixed - x0_fixed);
+    if (area_fixed < 0) {
+        area_fixed = -area_fixed;
+        SWAP_I32(x1_fixed,x2_fixed);
+        SWAP_I32(y1_fixed,y2_fixed);
         SWAP_F(w1,w2);
         SWAP_F(u1,u2);
         SWAP_F(v1,v2);
         SWAP_U32(c1,c2);
     }
-    if (fabsf(area) < 1e-6f) return;
+    if (area_fixed == 0) return;
+
+    // attributes are interpolated in float, from the snapped positions
+    x0 = x0_fixed / subpixel; y0 = y0_fixed / subpixel;
+    x1 = x1_fixed / subpixel; y1 = y1_fixed / subpixel;
+    x2 = x2_fixed / subpixel; y2 = y2_fixed / subpixel;
+    const float area = (float)area_fixed / (subpixel * subpixel);
 
     const int win_width = ctx->framebuffer.width;
-    const int win_height = ctx->framebuffer.height;
 
     const int min_x_f = (int) floorf(fmin(fmin(x0, x1), x2));
     const int min_y_f = (int) floorf(fmin(fmin(y0, y1), y2));
     const int max_x_f = (int)  ceilf(fmax(fmax(x0, x1), x2));
     const int max_y_f = (int)  ceilf(fmax(fmax(y0, y1), y2));
 
-    const int clamped_min_x = (min_x_f < 0) ? 0 : min_x_f;
-    const int clamped_min_y = (min_y_f < 0) ? 0 : min_y_f;
-    const int clamped_max_x = (max_x_f >= win_width) ? (win_width - 1) : max_x_f;
-    const int clamped_max_y = (max_y_f >= win_height) ? (win_height - 1) : max_y_f;
+    // interpolants are evaluated relative to this origin rather than stepped
+    // from the first drawn pixel, so a pixel gets the same value no matter
+    // which clip rectangle (tile) it is rasterized through
+    const int origin_x = (min_x_f < 0) ? 0 : min_x_f;
+    const int origin_y = (min_y_f < 0) ? 0 : min_y_f;
+
+    const int clamped_min_x = (origin_x < clip->min_x) ? clip->min_x : origin_x;
+    const int clamped_min_y = (origin_y < clip->min_y) ? clip->min_y : origin_y;
+    const int clamped_max_x = (max_x_f > clip->max_x) ? clip->max_x : max_x_f;
+    const int clamped_max_y = (max_y_f > clip->max_y) ? clip->max_y : max_y_f;
 
     if (clamped_min_x > clamped_max_x || clamped_min_y > clamped_max_y) return;
     
@@ -92,214 +121,261 @@ void RASTERIZER_NAME(
     const float depth_dx = rcp_area * (rcp_w0 * dx0 + rcp_w1 * dx1 + rcp_w2 * dx2);
     const float depth_dy = rcp_area * (rcp_w0 * dy0 + rcp_w1 * dy1 + rcp_w2 * dy2);
     
-    const float psx = clamped_min_x+0.5f;
-    const float psy = clamped_min_y+0.5f;
-    float w0_row = (psx - x1) * (y2 - y1) - (psy - y1) * (x2 - x1);
-    float w1_row = (psx - x2) * (y0 - y2) - (psy - y2) * (x0 - x2);
-    float w2_row = (psx - x0) * (y1 - y0) - (psy - y0) * (x1 - x0);
+    const float psx = origin_x+0.5f;
+    const float psy = origin_y+0.5f;
+    const float w0_origin = (psx - x1) * (y2 - y1) - (psy - y1) * (x2 - x1);
+    const float w1_origin = (psx - x2) * (y0 - y2) - (psy - y2) * (x0 - x2);
+    const float w2_origin = (psx - x0) * (y1 - y0) - (psy - y0) * (x1 - x0);
+
+    // edge functions in fixed point. the exact value at a pixel center is
+    // e_fixed = edge_dx * px + edge_dy * py + c in 1/subpixel^2 units; pixel
+    // centers are a whole number of subpixels * (1 << RASTER_SUBPIXEL_BITS)
+    // apart, so floor(e_fixed >> RASTER_SUBPIXEL_BITS) keeps the sign exactly
+    // and then steps by plain integer adds of edge_dx / edge_dy per pixel
+    const i32 edge0_dx = y2_fixed - y1_fixed;
+    const i32 edge0_dy = x1_fixed - x2_fixed;
+    const i32 edge1_dx = y0_fixed - y2_fixed;
+    const i32 edge1_dy = x2_fixed - x0_fixed;
+    const i32 edge2_dx = y1_fixed - y0_fixed;
+    const i32 edge2_dy = x0_fixed - x1_fixed;
+
+    // top-left fill rule: a pixel center exactly on an edge only belongs to
+    // the triangle when that edge is a left edge or a horizontal top edge, so
+    // pixels on edges shared by two triangles are drawn exactly once
+    const i64 bias0 = (edge0_dx > 0 || (edge0_dx == 0 && edge0_dy > 0)) ? 0 : -1;
+    const i64 bias1 = (edge1_dx > 0 || (edge1_dx == 0 && edge1_dy > 0)) ? 0 : -1;
+    const i64 bias2 = (edge2_dx > 0 || (edge2_dx == 0 && edge2_dy > 0)) ? 0 : -1;
+
+    const i64 center_x = ((i64)origin_x << RASTER_SUBPIXEL_BITS) + (1 << (RASTER_SUBPIXEL_BITS - 1));
+    const i64 center_y = ((i64)origin_y << RASTER_SUBPIXEL_BITS) + (1 << (RASTER_SUBPIXEL_BITS - 1));
+    const i32 e0_origin = (i32)(((center_x - x1_fixed) * edge0_dx + (center_y - y1_fixed) * edge0_dy + bias0) >> RASTER_SUBPIXEL_BITS);
+    const i32 e1_origin = (i32)(((center_x - x2_fixed) * edge1_dx + (center_y - y2_fixed) * edge1_dy + bias1) >> RASTER_SUBPIXEL_BITS);
+    const i32 e2_origin = (i32)(((center_x - x0_fixed) * edge2_dx + (center_y - y0_fixed) * edge2_dy + bias2) >> RASTER_SUBPIXEL_BITS);
     
-    float depth_recip_row = rcp_area * (rcp_w0 * w0_row + rcp_w1 * w1_row + rcp_w2 * w2_row);
+    const float depth_origin = rcp_area * (rcp_w0 * w0_origin + rcp_w1 * w1_origin + rcp_w2 * w2_origin);
 #if RASTER_GOURAUD == 1
-    float r_row = rcp_area * (r0_persp * w0_row + r1_persp * w1_row + r2_persp * w2_row);
-    float g_row = rcp_area * (g0_persp * w0_row + g1_persp * w1_row + g2_persp * w2_row);
-    float b_row = rcp_area * (b0_persp * w0_row + b1_persp * w1_row + b2_persp * w2_row);
+    const float r_origin = rcp_area * (r0_persp * w0_origin + r1_persp * w1_origin + r2_persp * w2_origin);
+    const float g_origin = rcp_area * (g0_persp * w0_origin + g1_persp * w1_origin + g2_persp * w2_origin);
+    const float b_origin = rcp_area * (b0_persp * w0_origin + b1_persp * w1_origin + b2_persp * w2_origin);
 #endif // RASTER_GOURAUD
 #if RASTER_TEXTURE == 1
-    float u_row = rcp_area * (u0_persp * w0_row + u1_persp * w1_row + u2_persp * w2_row);
-    float v_row = rcp_area * (v0_persp * w0_row + v1_persp * w1_row + v2_persp * w2_row);
+    const float u_origin = rcp_area * (u0_persp * w0_origin + u1_persp * w1_origin + u2_persp * w2_origin);
+    const float v_origin = rcp_area * (v0_persp * w0_origin + v1_persp * w1_origin + v2_persp * w2_origin);
 #endif // RASTER_TEXTURE
 
 #if RASTER_TEXTURE == 1
-
-    texture_t *texture = m_get_texture(ctx->material_manager, ctx->material_id);
     if (!texture) {
         return;
     }
-    const int tex_width = texture->width;
-    const int tex_height = texture->height;
-    const int tex_width_mask = tex_width - 1;
-    const int tex_height_mask = tex_height - 1;
+#ifdef SAMPLE_BILINEAR
+    const bool bilinear = true;
+#else
+    const bool bilinear = false;
 #endif
-#if RASTER_GOURAUD == 0 // flat shading
+    // level selection needs the uv derivatives, skipped when there is no chain
+    const mipmap_mode_t mipmap_mode = (texture->level_count > 1) ? ctx->mipmap_mode : MIPMAP_NONE;
+#endif
+#if RASTER_GOURAUD == 0 && RASTER_VISIBILITY == 0 // flat shading
     const u8 flat_r = (u8)((c0 >> 16) & 0xFF);
     const u8 flat_g = (u8)((c0 >>  8) & 0xFF);
     const u8 flat_b = (u8)( c0        & 0xFF);
 #endif // RASTER_GOURAUD
 
-    intptr_t row_offset = (intptr_t)clamped_min_y * win_width;
-    for (int y = clamped_min_y; y <= clamped_max_y; ++y) {
-        float* z_ptr = ctx->framebuffer.depth_buffer + row_offset + clamped_min_x;
-        u32* color_ptr = ctx->framebuffer.color_buffer + row_offset + clamped_min_x;
+    // smallest and largest change of each edge function across the pixel
+    // centers of a block, relative to its top-left pixel
+    const i32 block_extent = RASTER_BLOCK_SIZE - 1;
+    const i32 e0_lo = ((edge0_dx < 0) ? edge0_dx * block_extent : 0) + ((edge0_dy < 0) ? edge0_dy * block_extent : 0);
+    const i32 e1_lo = ((edge1_dx < 0) ? edge1_dx * block_extent : 0) + ((edge1_dy < 0) ? edge1_dy * block_extent : 0);
+    const i32 e2_lo = ((edge2_dx < 0) ? edge2_dx * block_extent : 0) + ((edge2_dy < 0) ? edge2_dy * block_extent : 0);
+    const i32 e0_hi = ((edge0_dx > 0) ? edge0_dx * block_extent : 0) + ((edge0_dy > 0) ? edge0_dy * block_extent : 0);
+    const i32 e1_hi = ((edge1_dx > 0) ? edge1_dx * block_extent : 0) + ((edge1_dy > 0) ? edge1_dy * block_extent : 0);
+    const i32 e2_hi = ((edge2_dx > 0) ? edge2_dx * block_extent : 0) + ((edge2_dy > 0) ? edge2_dy * block_extent : 0);
+
+    // hi-z: the depth plane is largest at one corner of a block, and inside the
+    // triangle it can never get nearer than its nearest vertex
+    const float depth_max = fmaxf(fmaxf(rcp_w0, rcp_w1), rcp_w2);
+    const float depth_block_hi = ((depth_dx > 0.0f) ? depth_dx * block_extent : 0.0f) + ((depth_dy > 0.0f) ? depth_dy * block_extent : 0.0f);
+    framebuffer_t* fb = &ctx->framebuffer;
+
+    // blocks are aligned to the screen grid and never cross a tile boundary,
+    // so the single-threaded and the tiled path visit the same spans and
+    // evaluate the same origin + offset * step expressions for every pixel.
+    // with -ffast-math the compiler is still free to reassociate them, so the
+    // two paths are expected, not guaranteed, to match bit for bit
+    const int block_mask = ~(RASTER_BLOCK_SIZE - 1);
+    for (int block_y = clamped_min_y & block_mask; block_y <= clamped_max_y; block_y += RASTER_BLOCK_SIZE) {
+        const int row_min = (block_y < clamped_min_y) ? clamped_min_y : block_y;
+        const int row_max = (block_y + RASTER_BLOCK_SIZE - 1 > clamped_max_y) ? clamped_max_y : block_y + RASTER_BLOCK_SIZE - 1;
+        const i32 e0_block_row = e0_origin + edge0_dy * (block_y - origin_y);
+        const i32 e1_block_row = e1_origin + edge1_dy * (block_y - origin_y);
+        const i32 e2_block_row = e2_origin + edge2_dy * (block_y - origin_y);
+
+        for (int block_x = clamped_min_x & block_mask; block_x <= clamped_max_x; block_x += RASTER_BLOCK_SIZE) {
+            const i32 e0 = e0_block_row + edge0_dx * (block_x - origin_x);
+            const i32 e1 = e1_block_row + edge1_dx * (block_x - origin_x);
+            const i32 e2 = e2_block_row + edge2_dx * (block_x - origin_x);
+
+            // trivial reject: every pixel center is outside one of the edges
+            if (e0 + e0_hi < 0 || e1 + e1_hi < 0 || e2 + e2_hi < 0) continue;
+            // trivial accept: every pixel center is inside all three edges
+            const bool covered = (e0 + e0_lo >= 0 && e1 + e1_lo >= 0 && e2 + e2_lo >= 0);
+
+            // hi-z reject: the nearest the triangle gets in this block is still
+            // behind the farthest depth already stored there
+            float block_depth = depth_origin + (block_y - origin_y) * depth_dy + (block_x - origin_x) * depth_dx + depth_block_hi;
+            block_depth = (block_depth > depth_max) ? depth_max : block_depth;
+            if (block_depth * (1.0f + RASTER_HIZ_EPSILON) < fb->hiz_buffer[(block_y / RASTER_BLOCK_SIZE) * fb->hiz_width + block_x / RASTER_BLOCK_SIZE]) continue;
+            bool written = false;
+
+            const int span_min_x = (block_x < clamped_min_x) ? clamped_min_x : block_x;
+            const int span_max_x = (block_x + RASTER_BLOCK_SIZE - 1 > clamped_max_x) ? clamped_max_x : block_x + RASTER_BLOCK_SIZE - 1;
+
+            for (int y = row_min; y <= row_max; ++y) {
+                const float fy = (float)(y - origin_y);
+                const float depth_row = depth_origin + fy * depth_dy;
+#if RASTER_GOURAUD == 1
+                const float r_row = r_origin + fy * r_dy;
+                const float g_row = g_origin + fy * g_dy;
+                const float b_row = b_origin + fy * b_dy;
+#endif // RASTER_GOURAUD
+#if RASTER_TEXTURE == 1
+                const float u_row = u_origin + fy * u_dy;
+                const float v_row = v_origin + fy * v_dy;
+#endif // RASTER_TEXTURE
+
+                const intptr_t offset = (intptr_t)y * win_width + span_min_x;
+                float* z_ptr = fb->depth_buffer + offset;
+#if RASTER_VISIBILITY == 1
+                u32* color_ptr = fb->id_buffer + offset;
+#else
+                u32* color_ptr = fb->color_buffer + offset;
+#endif
+
+                i32 e0_pixel = e0 + edge0_dy * (y - block_y) + edge0_dx * (span_min_x - block_x);
+                i32 e1_pixel = e1 + edge1_dy * (y - block_y) + edge1_dx * (span_min_x - block_x);
+                i32 e2_pixel = e2 + edge2_dy * (y - block_y) + edge2_dx * (span_min_x - block_x);
+
+                for (int x = span_min_x; x <= span_max_x; x++, z_ptr++, color_ptr++,
+                     e0_pixel += edge0_dx, e1_pixel += edge1_dx, e2_pixel += edge2_dx) {
+                    if (!covered && (e0_pixel | e1_pixel | e2_pixel) < 0) continue;
 
-        float w0_start = w0_row;
-        float w1_start = w1_row;
-        float w2_start = w2_row;
-        float depth    = depth_recip_row;
+                    const float fx = (float)(x - origin_x);
+
+                    const float depth = depth_row + fx * depth_dx;
+                    if (depth > *z_ptr) {
 #if RASTER_GOURAUD == 1
-        float r_start = r_row;
-        float g_start = g_row;
-        float b_start = b_row;
+                        const float r_start = r_row + fx * r_dx;
+                        const float g_start = g_row + fx * g_dx;
+                        const float b_start = b_row + fx * b_dx;
 #endif // RASTER_GOURAUD
 #if RASTER_TEXTURE == 1
-        float u_start = u_row;
-        float v_start = v_row;
+                        const float u_start = u_row + fx * u_dx;
+                        const float v_start = v_row + fx * v_dx;
 #endif // RASTER_TEXTURE
-        
-        for (int x = clamped_min_x; x <= clamped_max_x; x++) {
-            if (w0_start >= 0 && w1_start >= 0 && w2_start >= 0 && depth > *z_ptr) {
                 
 #if RASTER_GOURAUD == 1 && RASTER_TEXTURE == 1 // SGT (Scalar, Gouraud, Textured)
-                {
-                    const float inv_w = 1.0f / depth;
-                    const float u = u_start * inv_w;
-                    const float v = v_start * inv_w;
-                    const int  vr = r_start * inv_w;
-                    const int  vg = g_start * inv_w;
-                    const int  vb = b_start * inv_w;
-
-#ifdef SAMPLE_BILINEAR // bilinear sampling
-                    const float tex_u = u * tex_width;
-                    const float tex_v = v * tex_height;
-                    const int tex_x0 = ((int)tex_u) & tex_width_mask;
-                    const int tex_y0 = ((int)tex_v) & tex_height_mask;
-                    const int tex_x1 = (tex_x0 + 1) & tex_width_mask;
-                    const int tex_y1 = (tex_y0 + 1) & tex_height_mask;
-                    const float frac_u = tex_u - floorf(tex_u);
-                    const float frac_v = tex_v - floorf(tex_v);
-                    const u8* texel00 = texture->data + (tex_y0 * tex_width + tex_x0) * 4;
-                    const u8* texel10 = texture->data + (tex_y0 * tex_width + tex_x1) * 4;
-                    const u8* texel01 = texture->data + (tex_y1 * tex_width + tex_x0) * 4;
-                    const u8* texel11 = texture->data + (tex_y1 * tex_width + tex_x1) * 4;
-                    u8 texel[4];
-                    for (int i = 0; i < 4; ++i) {
-                        float c0 = texel00[i] * (1.0f - frac_u) + texel10[i] * frac_u;
-                        float c1 = texel01[i] * (1.0f - frac_u) + texel11[i] * frac_u;
-                        float c = c0 * (1.0f - frac_v) + c1 * frac_v;
-                        texel[i] = (u8)(c + 0.5f);
-                    }
-#else // nearest-neighbor sampling
-                    const int tex_x = (int)(u * tex_width) & tex_width_mask;
-                    const int tex_y = (int)(v * tex_height) & tex_height_mask;
-                    const u8* texel = texture->data + (tex_y * tex_width + tex_x) * 4;
-#endif // SAMPLE MODE
-
-                    if (texel[3] != 0x00) { // TODO: blending
-                        const u8 tr = texel[0];
-                        const u8 tg = texel[1];
-                        const u8 tb = texel[2];
-
-                        int mod_r = (tr * vr) >> 8;
-                        int mod_g = (tg * vg) >> 8;
-                        int mod_b = (tb * vb) >> 8;
+                        {
+                            const float inv_w = 1.0f / depth;
+                            const float u = u_start * inv_w;
+                            const float v = v_start * inv_w;
+                            const int  vr = r_start * inv_w;
+                            const int  vg = g_start * inv_w;
+                            const int  vb = b_start * inv_w;
+
+                            float lod = 0.0f;
+                            if (mipmap_mode != MIPMAP_NONE) {
+                                lod = texture_lod(texture, (u_dx - u * depth_dx) * inv_w, (v_dx - v * depth_dx) * inv_w,
+                                                           (u_dy - u * depth_dy) * inv_w, (v_dy - v * depth_dy) * inv_w);
+                            }
+                            const u32 texel = texture_sample(texture, mipmap_mode, lod, u, v, bilinear);
+
+                            if ((texel >> 24) != 0x00) { // TODO: blending
+                                const int tr = texel & 0xFF;
+                                const int tg = (texel >>  8) & 0xFF;
+                                const int tb = (texel >> 16) & 0xFF;
+
+                                int mod_r = (tr * vr) >> 8;
+                                int mod_g = (tg * vg) >> 8;
+                                int mod_b = (tb * vb) >> 8;
                         
-                        mod_r = (mod_r < 0) ? 0 : (mod_r > 255) ? 255 : mod_r;
-                        mod_g = (mod_g < 0) ? 0 : (mod_g > 255) ? 255 : mod_g;
-                        mod_b = (mod_b < 0) ? 0 : (mod_b > 255) ? 255 : mod_b;
+                                mod_r = (mod_r < 0) ? 0 : (mod_r > 255) ? 255 : mod_r;
+                                mod_g = (mod_g < 0) ? 0 : (mod_g > 255) ? 255 : mod_g;
+                                mod_b = (mod_b < 0) ? 0 : (mod_b > 255) ? 255 : mod_b;
                         
-                        *z_ptr = depth;
-                        *color_ptr = 0xffu << 24 | mod_r << 16 | mod_g << 8 | mod_b;
-                    }
-                }
+                                *z_ptr = depth;
+                                written = true;
+                                *color_ptr = 0xffu << 24 | mod_r << 16 | mod_g << 8 | mod_b;
+                            }
+                        }
 #elif RASTER_GOURAUD == 1 && RASTER_TEXTURE == 0 // SGC (Scalar, Gouraud, Colored)
-                {
-                    const float inv_w = 1.0f / depth;
-                    int vr = (int)(r_start * inv_w);
-                    int vg = (int)(g_start * inv_w);
-                    int vb = (int)(b_start * inv_w);
-
-                    vr = (vr < 0) ? 0 : (vr > 255) ? 255 : vr;
-                    vg = (vg < 0) ? 0 : (vg > 255) ? 255 : vg;
-                    vb = (vb < 0) ? 0 : (vb > 255) ? 255 : vb;
+                        {
+                            const float inv_w = 1.0f / depth;
+                            int vr = (int)(r_start * inv_w);
+                            int vg = (int)(g_start * inv_w);
+                            int vb = (int)(b_start * inv_w);
+
+                            vr = (vr < 0) ? 0 : (vr > 255) ? 255 : vr;
+                            vg = (vg < 0) ? 0 : (vg > 255) ? 255 : vg;
+                            vb = (vb < 0) ? 0 : (vb > 255) ? 255 : vb;
                     
-                    *z_ptr = depth;
-                    *color_ptr = 0xffu << 24 | vr << 16 | vg << 8 | vb;
-                }
+                            *z_ptr = depth;
+                            written = true;
+                            *color_ptr = 0xffu << 24 | vr << 16 | vg << 8 | vb;
+                        }
 #elif RASTER_GOURAUD == 0 && RASTER_TEXTURE == 1 // SFT (Scalar, Flat, Textured)
-                {
-                    const float inv_w = 1.0f / depth;
-                    const float u = u_start * inv_w;
-                    const float v = v_start * inv_w;
-
-#ifdef SAMPLE_BILINEAR // bilinear sampling
-                    const float tex_u = u * tex_width;
-                    const float tex_v = v * tex_height;
-                    const int tex_x0 = ((int)tex_u) & tex_width_mask;
-                    const int tex_y0 = ((int)tex_v) & tex_height_mask;
-                    const int tex_x1 = (tex_x0 + 1) & tex_width_mask;
-                    const int tex_y1 = (tex_y0 + 1) & tex_height_mask;
-                    const float frac_u = tex_u - floorf(tex_u);
-                    const float frac_v = tex_v - floorf(tex_v);
-                    const u8* texel00 = texture->data + (tex_y0 * tex_width + tex_x0) * 4;
-                    const u8* texel10 = texture->data + (tex_y0 * tex_width + tex_x1) * 4;
-                    const u8* texel01 = texture->data + (tex_y1 * tex_width + tex_x0) * 4;
-                    const u8* texel11 = texture->data + (tex_y1 * tex_width + tex_x1) * 4;
-                    u8 texel[4];
-                    for (int i = 0; i < 4; ++i) {
-                        float c0 = texel00[i] * (1.0f - frac_u) + texel10[i] * frac_u;
-                        float c1 = texel01[i] * (1.0f - frac_u) + texel11[i] * frac_u;
-                        float c = c0 * (1.0f - frac_v) + c1 * frac_v;
-                        texel[i] = (u8)(c + 0.5f);
-                    }
-#else // nearest-neighbor sampling
-                    const int tex_x = (int)(u * tex_width) & tex_width_mask;
-                    const int tex_y = (int)(v * tex_height) & tex_height_mask;
-                    const u8* texel = texture->data + (tex_y * tex_width + tex_x) * 4;
-#endif // SAMPLE MODE
+                        {
+                            const float inv_w = 1.0f / depth;
+                            const float u = u_start * inv_w;
+                            const float v = v_start * inv_w;
+
+                            float lod = 0.0f;
+                            if (mipmap_mode != MIPMAP_NONE) {
+                                lod = texture_lod(texture, (u_dx - u * depth_dx) * inv_w, (v_dx - v * depth_dx) * inv_w,
+                                                           (u_dy - u * depth_dy) * inv_w, (v_dy - v * depth_dy) * inv_w);
+                            }
+                            const u32 texel = texture_sample(texture, mipmap_mode, lod, u, v, bilinear);
                     
-                    if (texel[3] != 0x00) {
-                        int mod_r = (texel[0] * flat_r) >> 8;
-                        int mod_g = (texel[1] * flat_g) >> 8;
-                        int mod_b = (texel[2] * flat_b) >> 8;
+                            if ((texel >> 24) != 0x00) {
+#if RASTER_VISIBILITY == 1
+                                *z_ptr = depth;
+                                written = true;
+                                *color_ptr = c0;
+#else
+                                int mod_r = ((int)( texel        & 0xFF) * flat_r) >> 8;
+                                int mod_g = ((int)((texel >>  8) & 0xFF) * flat_g) >> 8;
+                                int mod_b = ((int)((texel >> 16) & 0xFF) * flat_b) >> 8;
                         
-                        *z_ptr = depth;
-                        *color_ptr = 0xffu << 24 | mod_r << 16 | mod_g << 8 | mod_b;
-                    }
-                }
+                                *z_ptr = depth;
+                                written = true;
+                                *color_ptr = 0xffu << 24 | mod_r << 16 | mod_g << 8 | mod_b;
+#endif // RASTER_VISIBILITY
+                            }
+                        }
 #elif RASTER_GOURAUD == 0 && RASTER_TEXTURE == 0 // SFC (Scalar, Flat, Colored)
-                {
-                    *z_ptr = depth;
-                    *color_ptr = 0xffu << 24 | flat_r << 16 | flat_g << 8 | flat_b;
-                }
+                        {
+                            *z_ptr = depth;
+                            written = true;
+#if RASTER_VISIBILITY == 1
+                            *color_ptr = c0;
+#else
+                            *color_ptr = 0xffu << 24 | flat_r << 16 | flat_g << 8 | flat_b;
+#endif // RASTER_VISIBILITY
+                        }
 #endif // end of shader types
+                    }
+                }
             }
-            
-            w0_start += dx0;
-            w1_start += dx1;
-            w2_start += dx2;
-            depth    += depth_dx;
-#if RASTER_GOURAUD == 1
-            r_start += r_dx;
-            g_start += g_dx;
-            b_start += b_dx;
-#endif // RASTER_GOURAUD
-#if RASTER_TEXTURE == 1
-            u_start += u_dx;
-            v_start += v_dx;
-#endif // RASTER_TEXTURE
-            z_ptr++;
-            color_ptr++;
-        }
 
-        w0_row += dy0;
-        w1_row += dy1;
-        w2_row += dy2;
-        depth_recip_row += depth_dy;
-#if RASTER_GOURAUD == 1
-        r_row += r_dy;
-        g_row += g_dy;
-        b_row += b_dy;
-#endif // RASTER_GOURAUD
-#if RASTER_TEXTURE == 1
-        u_row += u_dy;
-        v_row += v_dy;
-#endif // RASTER_TEXTURE
-        row_offset += win_width;
+            if (written) hiz_update_block(fb, block_x, block_y);
+        }
     }
 }
 
 #undef SWAP_F
 #undef SWAP_U32
+#undef SWAP_I32
 #undef RASTERIZER_NAME
 #undef RASTER_GOURAUD
 #undef RASTER_TEXTURE
+#undef RASTER_VISIBILITY
 #undef SAMPLE_BILINEAR
\ No newline at end of file
@@ -0,0 +1,330 @@
+// 8-wide avx2 counterpart of triangle_template.h, same permutation macros:
+// RASTERIZER_NAME, RASTER_GOURAUD, RASTER_TEXTURE, RASTER_VISIBILITY and SAMPLE_BILINEAR.
+// pixels are processed in 8x8 blocks aligned to the screen grid, one 8-wide
+// row at a time, and every write goes through a lane mask, so a block never
+// touches pixels outside the clip
+
+#if RASTER_BLOCK_SIZE != 8
+#error "triangle_template_simd.h expects RASTER_BLOCK_SIZE to match the 8-wide lanes"
+#endif
+
+#include "sampler.h"
+
+#ifndef RASTER_VISIBILITY
+#define RASTER_VISIBILITY 0
+#endif
+
+#define SWAP_F(a, b) do { float t = a; a = b; b = t; } while (0)
+#define SWAP_U32(a, b) do { u32 t = a; a = b; b = t; } while (0)
+#define SWAP_I32(a, b) do { i32 t = a; a = b; b = t; } while (0)
+
+void RASTERIZER_NAME(
+        render_context *ctx, texture_t *texture, const raster_rect_t *clip,
+        float x0, float y0, float w0, float u0, float v0, u32 c0,
+        float x1, float y1, float w1, float u1, float v1, u32 c1,
+        float x2, float y2, float w2, float u2, float v2, u32 c2) {
+
+    // snap to the subpixel grid, coverage is decided on these exact positions
+    const float subpixel = (float)(1 << RASTER_SUBPIXEL_BITS);
+    i32 x0_fixed = (i32)lrintf(x0 * subpixel);
+    i32 y0_fixed = (i32)lrintf(y0 * subpixel);
+    i32 x1_fixed = (i32)lrintf(x1 * subpixel);
+    i32 y1_fixed = (i32)lrintf(y1 * subpixel);
+    i32 x2_fixed = (i32)lrintf(x2 * subpixel);
+    i32 y2_fixed = (i32)lrintf(y2 * subpixel);
+
+    i64 area_fixed = (i64)(x2_fixed - x0_fixed) * (y1_fixed - y0_fixed) - (i64)(y2_fixed - y0_fixed) * (x1_fixed - x0_fixed);
+    if (area_fixed < 0) {
+        area_fixed = -area_fixed;
+        SWAP_I32(x1_fixed,x2_fixed);
+        SWAP_I32(y1_fixed,y2_fixed);
+        SWAP_F(w1,w2);
+        SWAP_F(u1,u2);
+        SWAP_F(v1,v2);
+        SWAP_U32(c1,c2);
+    }
+    if (area_fixed == 0) return;
+
+    // attributes are interpolated in float, from the snapped positions
+    x0 = x0_fixed / subpixel; y0 = y0_fixed / subpixel;
+    x1 = x1_fixed / subpixel; y1 = y1_fixed / subpixel;
+    x2 = x2_fixed / subpixel; y2 = y2_fixed / subpixel;
+    const float area = (float)area_fixed / (subpixel * subpixel);
+
+    const int win_width = ctx->framebuffer.width;
+
+    const int min_x_f = (int) floorf(fmin(fmin(x0, x1), x2));
+    const int min_y_f = (int) floorf(fmin(fmin(y0, y1), y2));
+    const int max_x_f = (int)  ceilf(fmax(fmax(x0, x1), x2));
+    const int max_y_f = (int)  ceilf(fmax(fmax(y0, y1), y2));
+
+    const int origin_x = (min_x_f < 0) ? 0 : min_x_f;
+    const int origin_y = (min_y_f < 0) ? 0 : min_y_f;
+
+    const int clamped_min_x = (origin_x < clip->min_x) ? clip->min_x : origin_x;
+    const int clamped_min_y = (origin_y < clip->min_y) ? clip->min_y : origin_y;
+    const int clamped_max_x = (max_x_f > clip->max_x) ? clip->max_x : max_x_f;
+    const int clamped_max_y = (max_y_f > clip->max_y) ? clip->max_y : max_y_f;
+
+    if (clamped_min_x > clamped_max_x || clamped_min_y > clamped_max_y) return;
+
+#if RASTER_TEXTURE == 1
+    if (!texture) {
+        return;
+    }
+#ifdef SAMPLE_BILINEAR
+    const bool bilinear = true;
+#else
+    const bool bilinear = false;
+#endif
+    const mipmap_mode_t mipmap_mode = (texture->level_count > 1) ? ctx->mipmap_mode : MIPMAP_NONE;
+#endif
+
+    const float rcp_area = 1.0f / area;
+    const float rcp_w0 = 1.0f / w0;
+    const float rcp_w1 = 1.0f / w1;
+    const float rcp_w2 = 1.0f / w2;
+
+    const float dx0 = y2 - y1;
+    const float dy0 = x1 - x2;
+    const float dx1 = y0 - y2;
+    const float dy1 = x2 - x0;
+    const float dx2 = y1 - y0;
+    const float dy2 = x0 - x1;
+
+    const float psx = origin_x+0.5f;
+    const float psy = origin_y+0.5f;
+    const float w0_origin = (psx - x1) * (y2 - y1) - (psy - y1) * (x2 - x1);
+    const float w1_origin = (psx - x2) * (y0 - y2) - (psy - y2) * (x0 - x2);
+    const float w2_origin = (psx - x0) * (y1 - y0) - (psy - y0) * (x1 - x0);
+
+    // edge functions in fixed point. the exact value at a pixel center is
+    // e_fixed = edge_dx * px + edge_dy * py + c in 1/subpixel^2 units; pixel
+    // centers are a whole number of subpixels * (1 << RASTER_SUBPIXEL_BITS)
+    // apart, so floor(e_fixed >> RASTER_SUBPIXEL_BITS) keeps the sign exactly
+    // and then steps by plain integer adds of edge_dx / edge_dy per pixel
+    const i32 edge0_dx = y2_fixed - y1_fixed;
+    const i32 edge0_dy = x1_fixed - x2_fixed;
+    const i32 edge1_dx = y0_fixed - y2_fixed;
+    const i32 edge1_dy = x2_fixed - x0_fixed;
+    const i32 edge2_dx = y1_fixed - y0_fixed;
+    const i32 edge2_dy = x0_fixed - x1_fixed;
+
+    // top-left fill rule: a pixel center exactly on an edge only belongs to
+    // the triangle when that edge is a left edge or a horizontal top edge, so
+    // pixels on edges shared by two triangles are drawn exactly once
+    const i64 bias0 = (edge0_dx > 0 || (edge0_dx == 0 && edge0_dy > 0)) ? 0 : -1;
+    const i64 bias1 = (edge1_dx > 0 || (edge1_dx == 0 && edge1_dy > 0)) ? 0 : -1;
+    const i64 bias2 = (edge2_dx > 0 || (edge2_dx == 0 && edge2_dy > 0)) ? 0 : -1;
+
+    const i64 center_x = ((i64)origin_x << RASTER_SUBPIXEL_BITS) + (1 << (RASTER_SUBPIXEL_BITS - 1));
+    const i64 center_y = ((i64)origin_y << RASTER_SUBPIXEL_BITS) + (1 << (RASTER_SUBPIXEL_BITS - 1));
+    const i32 e0_origin = (i32)(((center_x - x1_fixed) * edge0_dx + (center_y - y1_fixed) * edge0_dy + bias0) >> RASTER_SUBPIXEL_BITS);
+    const i32 e1_origin = (i32)(((center_x - x2_fixed) * edge1_dx + (center_y - y2_fixed) * edge1_dy + bias1) >> RASTER_SUBPIXEL_BITS);
+    const i32 e2_origin = (i32)(((center_x - x0_fixed) * edge2_dx + (center_y - y0_fixed) * edge2_dy + bias2) >> RASTER_SUBPIXEL_BITS);
+
+    const float depth_dx = rcp_area * (rcp_w0 * dx0 + rcp_w1 * dx1 + rcp_w2 * dx2);
+    const float depth_dy = rcp_area * (rcp_w0 * dy0 + rcp_w1 * dy1 + rcp_w2 * dy2);
+    const float depth_origin = rcp_area * (rcp_w0 * w0_origin + rcp_w1 * w1_origin + rcp_w2 * w2_origin);
+
+#if RASTER_GOURAUD == 1
+    const float r0_persp = (float)((c0 >> 16) & 0xFF) * rcp_w0;
+    const float g0_persp = (float)((c0 >>  8) & 0xFF) * rcp_w0;
+    const float b0_persp = (float)( c0        & 0xFF) * rcp_w0;
+    const float r1_persp = (float)((c1 >> 16) & 0xFF) * rcp_w1;
+    const float g1_persp = (float)((c1 >>  8) & 0xFF) * rcp_w1;
+    const float b1_persp = (float)( c1        & 0xFF) * rcp_w1;
+    const float r2_persp = (float)((c2 >> 16) & 0xFF) * rcp_w2;
+    const float g2_persp = (float)((c2 >>  8) & 0xFF) * rcp_w2;
+    const float b2_persp = (float)( c2        & 0xFF) * rcp_w2;
+
+    const __m256 r_dx = _mm256_set1_ps(rcp_area * (r0_persp * dx0 + r1_persp * dx1 + r2_persp * dx2));
+    const __m256 g_dx = _mm256_set1_ps(rcp_area * (g0_persp * dx0 + g1_persp * dx1 + g2_persp * dx2));
+    const __m256 b_dx = _mm256_set1_ps(rcp_area * (b0_persp * dx0 + b1_persp * dx1 + b2_persp * dx2));
+    const float r_dy = rcp_area * (r0_persp * dy0 + r1_persp * dy1 + r2_persp * dy2);
+    const float g_dy = rcp_area * (g0_persp * dy0 + g1_persp * dy1 + g2_persp * dy2);
+    const float b_dy = rcp_area * (b0_persp * dy0 + b1_persp * dy1 + b2_persp * dy2);
+    const float r_origin = rcp_area * (r0_persp * w0_origin + r1_persp * w1_origin + r2_persp * w2_origin);
+    const float g_origin = rcp_area * (g0_persp * w0_origin + g1_persp * w1_origin + g2_persp * w2_origin);
+    const float b_origin = rcp_area * (b0_persp * w0_origin + b1_persp * w1_origin + b2_persp * w2_origin);
+#elif RASTER_VISIBILITY == 0 // flat shading
+    const __m256i flat_r = _mm256_set1_epi32((c0 >> 16) & 0xFF);
+    const __m256i flat_g = _mm256_set1_epi32((c0 >>  8) & 0xFF);
+    const __m256i flat_b = _mm256_set1_epi32( c0        & 0xFF);
+#endif // RASTER_GOURAUD
+
+#if RASTER_TEXTURE == 1
+    const float u0_persp = u0 * rcp_w0;
+    const float u1_persp = u1 * rcp_w1;
+    const float u2_persp = u2 * rcp_w2;
+    const float v0_persp = v0 * rcp_w0;
+    const float v1_persp = v1 * rcp_w1;
+    const float v2_persp = v2 * rcp_w2;
+
+    const __m256 u_dx = _mm256_set1_ps(rcp_area * (u0_persp * dx0 + u1_persp * dx1 + u2_persp * dx2));
+    const __m256 v_dx = _mm256_set1_ps(rcp_area * (v0_persp * dx0 + v1_persp * dx1 + v2_persp * dx2));
+    const float u_dy = rcp_area * (u0_persp * dy0 + u1_persp * dy1 + u2_persp * dy2);
+    const float v_dy = rcp_area * (v0_persp * dy0 + v1_persp * dy1 + v2_persp * dy2);
+    const float u_origin = rcp_area * (u0_persp * w0_origin + u1_persp * w1_origin + u2_persp * w2_origin);
+    const float v_origin = rcp_area * (v0_persp * w0_origin + v1_persp * w1_origin + v2_persp * w2_origin);
+#endif // RASTER_TEXTURE
+
+    const __m256 depth_dx_v = _mm256_set1_ps(depth_dx);
+    const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i e0_lane = _mm256_mullo_epi32(lane, _mm256_set1_epi32(edge0_dx));
+    const __m256i e1_lane = _mm256_mullo_epi32(lane, _mm256_set1_epi32(edge1_dx));
+    const __m256i e2_lane = _mm256_mullo_epi32(lane, _mm256_set1_epi32(edge2_dx));
+    const __m256i span_min = _mm256_set1_epi32(clamped_min_x - 1);
+    const __m256i span_max = _mm256_set1_epi32(clamped_max_x + 1);
+
+    // smallest and largest change of each edge function across the pixel
+    // centers of a block, relative to its top-left pixel
+    const i32 block_extent = RASTER_BLOCK_SIZE - 1;
+    const i32 e0_lo = ((edge0_dx < 0) ? edge0_dx * block_extent : 0) + ((edge0_dy < 0) ? edge0_dy * block_extent : 0);
+    const i32 e1_lo = ((edge1_dx < 0) ? edge1_dx * block_extent : 0) + ((edge1_dy < 0) ? edge1_dy * block_extent : 0);
+    const i32 e2_lo = ((edge2_dx < 0) ? edge2_dx * block_extent : 0) + ((edge2_dy < 0) ? edge2_dy * block_extent : 0);
+    const i32 e0_hi = ((edge0_dx > 0) ? edge0_dx * block_extent : 0) + ((edge0_dy > 0) ? edge0_dy * block_extent : 0);
+    const i32 e1_hi = ((edge1_dx > 0) ? edge1_dx * block_extent : 0) + ((edge1_dy > 0) ? edge1_dy * block_extent : 0);
+    const i32 e2_hi = ((edge2_dx > 0) ? edge2_dx * block_extent : 0) + ((edge2_dy > 0) ? edge2_dy * block_extent : 0);
+
+    // hi-z: the depth plane is largest at one corner of a block, and inside the
+    // triangle it can never get nearer than its nearest vertex
+    const float depth_max = fmaxf(fmaxf(rcp_w0, rcp_w1), rcp_w2);
+    const float depth_block_hi = ((depth_dx > 0.0f) ? depth_dx * block_extent : 0.0f) + ((depth_dy > 0.0f) ? depth_dy * block_extent : 0.0f);
+    framebuffer_t* fb = &ctx->framebuffer;
+
+    const int block_mask = ~(RASTER_BLOCK_SIZE - 1);
+    for (int block_y = clamped_min_y & block_mask; block_y <= clamped_max_y; block_y += RASTER_BLOCK_SIZE) {
+        const int row_min = (block_y < clamped_min_y) ? clamped_min_y : block_y;
+        const int row_max = (block_y + RASTER_BLOCK_SIZE - 1 > clamped_max_y) ? clamped_max_y : block_y + RASTER_BLOCK_SIZE - 1;
+        const i32 e0_block_row = e0_origin + edge0_dy * (block_y - origin_y);
+        const i32 e1_block_row = e1_origin + edge1_dy * (block_y - origin_y);
+        const i32 e2_block_row = e2_origin + edge2_dy * (block_y - origin_y);
+
+        for (int block_x = clamped_min_x & block_mask; block_x <= clamped_max_x; block_x += RASTER_BLOCK_SIZE) {
+            const i32 e0 = e0_block_row + edge0_dx * (block_x - origin_x);
+            const i32 e1 = e1_block_row + edge1_dx * (block_x - origin_x);
+            const i32 e2 = e2_block_row + edge2_dx * (block_x - origin_x);
+
+            // trivial reject: every pixel center is outside one of the edges
+            if (e0 + e0_hi < 0 || e1 + e1_hi < 0 || e2 + e2_hi < 0) continue;
+            // trivial accept: every pixel center is inside all three edges
+            const bool covered = (e0 + e0_lo >= 0 && e1 + e1_lo >= 0 && e2 + e2_lo >= 0);
+
+            // hi-z reject: the nearest the triangle gets in this block is still
+            // behind the farthest depth already stored there
+            float block_depth = depth_origin + (block_y - origin_y) * depth_dy + (block_x - origin_x) * depth_dx + depth_block_hi;
+            block_depth = (block_depth > depth_max) ? depth_max : block_depth;
+            if (block_depth * (1.0f + RASTER_HIZ_EPSILON) < fb->hiz_buffer[(block_y / RASTER_BLOCK_SIZE) * fb->hiz_width + block_x / RASTER_BLOCK_SIZE]) continue;
+            __m256 written = _mm256_setzero_ps();
+
+            const __m256i xs = _mm256_add_epi32(_mm256_set1_epi32(block_x), lane);
+            const __m256 fx = _mm256_cvtepi32_ps(_mm256_sub_epi32(xs, _mm256_set1_epi32(origin_x)));
+            const __m256 range_mask = _mm256_castsi256_ps(_mm256_and_si256(_mm256_cmpgt_epi32(xs, span_min), _mm256_cmpgt_epi32(span_max, xs)));
+
+            i32 e0_row = e0 + edge0_dy * (row_min - block_y);
+            i32 e1_row = e1 + edge1_dy * (row_min - block_y);
+            i32 e2_row = e2 + edge2_dy * (row_min - block_y);
+
+            for (int y = row_min; y <= row_max; ++y, e0_row += edge0_dy, e1_row += edge1_dy, e2_row += edge2_dy) {
+                const float fy = (float)(y - origin_y);
+                __m256 mask = range_mask;
+                if (!covered) {
+                    // a pixel is inside when none of the three edge values has its sign bit set
+                    const __m256i w0 = _mm256_add_epi32(_mm256_set1_epi32(e0_row), e0_lane);
+                    const __m256i w1 = _mm256_add_epi32(_mm256_set1_epi32(e1_row), e1_lane);
+                    const __m256i w2 = _mm256_add_epi32(_mm256_set1_epi32(e2_row), e2_lane);
+                    const __m256i outside = _mm256_or_si256(_mm256_or_si256(w0, w1), w2);
+                    mask = _mm256_andnot_ps(_mm256_castsi256_ps(_mm256_srai_epi32(outside, 31)), mask);
+                    if (_mm256_movemask_ps(mask) == 0) continue;
+                }
+
+                const intptr_t offset = (intptr_t)y * win_width + block_x;
+                float* z_ptr = fb->depth_buffer + offset;
+#if RASTER_VISIBILITY == 1
+                u32* color_ptr = fb->id_buffer + offset;
+#else
+                u32* color_ptr = fb->color_buffer + offset;
+#endif
+
+                const __m256 depth = _mm256_fmadd_ps(fx, depth_dx_v, _mm256_set1_ps(depth_origin + fy * depth_dy));
+                const __m256 z = _mm256_maskload_ps(z_ptr, _mm256_castps_si256(mask));
+                mask = _mm256_and_ps(mask, _mm256_cmp_ps(depth, z, _CMP_GT_OQ));
+                if (_mm256_movemask_ps(mask) == 0) continue;
+
+#if RASTER_GOURAUD == 1
+                const __m256 r_row = _mm256_set1_ps(r_origin + fy * r_dy);
+                const __m256 g_row = _mm256_set1_ps(g_origin + fy * g_dy);
+                const __m256 b_row = _mm256_set1_ps(b_origin + fy * b_dy);
+#endif // RASTER_GOURAUD
+#if RASTER_TEXTURE == 1
+                const __m256 u_row = _mm256_set1_ps(u_origin + fy * u_dy);
+                const __m256 v_row = _mm256_set1_ps(v_origin + fy * v_dy);
+#endif // RASTER_TEXTURE
+
+#if RASTER_GOURAUD == 1 || RASTER_TEXTURE == 1
+                const __m256 inv_w = _mm256_div_ps(_mm256_set1_ps(1.0f), depth);
+#endif
+#if RASTER_GOURAUD == 1
+                const __m256i vr = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_fmadd_ps(fx, r_dx, r_row), inv_w));
+                const __m256i vg = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_fmadd_ps(fx, g_dx, g_row), inv_w));
+                const __m256i vb = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_fmadd_ps(fx, b_dx, b_row), inv_w));
+#endif // RASTER_GOURAUD
+#if RASTER_TEXTURE == 1
+                const __m256 u = _mm256_mul_ps(_mm256_fmadd_ps(fx, u_dx, u_row), inv_w);
+                const __m256 v = _mm256_mul_ps(_mm256_fmadd_ps(fx, v_dx, v_row), inv_w);
+                __m256 lod = _mm256_setzero_ps();
+                if (mipmap_mode != MIPMAP_NONE) {
+                    lod = simd_texture_lod(texture,
+                        _mm256_mul_ps(_mm256_fnmadd_ps(u, depth_dx_v, u_dx), inv_w),
+                        _mm256_mul_ps(_mm256_fnmadd_ps(v, depth_dx_v, v_dx), inv_w),
+                        _mm256_mul_ps(_mm256_fnmadd_ps(u, _mm256_set1_ps(depth_dy), _mm256_set1_ps(u_dy)), inv_w),
+                        _mm256_mul_ps(_mm256_fnmadd_ps(v, _mm256_set1_ps(depth_dy), _mm256_set1_ps(v_dy)), inv_w));
+                }
+                const __m256i texel = simd_sample(texture, mipmap_mode, lod, u, v, bilinear);
+                // TODO: blending, for now fully transparent texels are discarded
+                const __m256i alpha = _mm256_srli_epi32(texel, 24);
+                mask = _mm256_andnot_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(alpha, _mm256_setzero_si256())), mask);
+#if RASTER_VISIBILITY == 0
+                const __m256i tr = _mm256_and_si256(texel, _mm256_set1_epi32(0xFF));
+                const __m256i tg = _mm256_and_si256(_mm256_srli_epi32(texel,  8), _mm256_set1_epi32(0xFF));
+                const __m256i tb = _mm256_and_si256(_mm256_srli_epi32(texel, 16), _mm256_set1_epi32(0xFF));
+#endif // RASTER_VISIBILITY
+#endif // RASTER_TEXTURE
+
+#if RASTER_VISIBILITY == 1 // triangle id
+                const __m256i color = _mm256_set1_epi32((int)c0);
+#elif RASTER_GOURAUD == 1 && RASTER_TEXTURE == 1 // VGT (SIMD, Gouraud, Textured)
+                const __m256i color = simd_pack_rgb(
+                    simd_clamp_u8(_mm256_srai_epi32(_mm256_mullo_epi32(tr, vr), 8)),
+                    simd_clamp_u8(_mm256_srai_epi32(_mm256_mullo_epi32(tg, vg), 8)),
+                    simd_clamp_u8(_mm256_srai_epi32(_mm256_mullo_epi32(tb, vb), 8)));
+#elif RASTER_GOURAUD == 1 && RASTER_TEXTURE == 0 // VGC (SIMD, Gouraud, Colored)
+                const __m256i color = simd_pack_rgb(simd_clamp_u8(vr), simd_clamp_u8(vg), simd_clamp_u8(vb));
+#elif RASTER_GOURAUD == 0 && RASTER_TEXTURE == 1 // VFT (SIMD, Flat, Textured)
+                const __m256i color = simd_pack_rgb(
+                    _mm256_srli_epi32(_mm256_mullo_epi32(tr, flat_r), 8),
+                    _mm256_srli_epi32(_mm256_mullo_epi32(tg, flat_g), 8),
+                    _mm256_srli_epi32(_mm256_mullo_epi32(tb, flat_b), 8));
+#elif RASTER_GOURAUD == 0 && RASTER_TEXTURE == 0 // VFC (SIMD, Flat, Colored)
+                const __m256i color = simd_pack_rgb(flat_r, flat_g, flat_b);
+#endif // end of shader types
+
+                _mm256_maskstore_ps(z_ptr, _mm256_castps_si256(mask), depth);
+                _mm256_maskstore_epi32((int*)color_ptr, _mm256_castps_si256(mask), color);
+                written = _mm256_or_ps(written, mask);
+            }
+
+            if (_mm256_movemask_ps(written) != 0) hiz_update_block(fb, block_x, block_y);
+        }
+    }
+}
+
+#undef SWAP_F
+#undef SWAP_U32
+#undef SWAP_I32
+#undef RASTERIZER_NAME
+#undef RASTER_GOURAUD
+#undef RASTER_TEXTURE
+#undef RASTER_VISIBILITY
+#undef SAMPLE_BILINEAR
@@ -0,0 +1,171 @@
+#include "visibility.h"
+#include "sampler.h"
+#include "array.h"
+
+static visibility_plane_t visibility_plane(float dx1, float dy1, float dx2, float dy2, float rcp_det, float a0, float a1, float a2) {
+    visibility_plane_t p;
+    p.a  = a0;
+    p.dx = ((a1 - a0) * dy2 - (a2 - a0) * dy1) * rcp_det;
+    p.dy = ((a2 - a0) * dx1 - (a1 - a0) * dx2) * rcp_det;
+    return p;
+}
+
+static inline float visibility_eval(const visibility_plane_t* p, float fx, float fy) {
+    return p->a + p->dx * fx + p->dy * fy;
+}
+
+u32 visibility_add_triangle(render_context* ctx, shader_type_t shader_type, texture_t* texture, const raster_vertex_t v[3]) {
+    const float dx1 = v[1].x - v[0].x, dy1 = v[1].y - v[0].y;
+    const float dx2 = v[2].x - v[0].x, dy2 = v[2].y - v[0].y;
+    const float det = dx1 * dy2 - dx2 * dy1;
+    if (det == 0.0f) return 0;
+    const float rcp_det = 1.0f / det;
+
+    const float rcp_w0 = 1.0f / v[0].w;
+    const float rcp_w1 = 1.0f / v[1].w;
+    const float rcp_w2 = 1.0f / v[2].w;
+
+    visibility_triangle_t t = {0};
+    t.gouraud  = (shader_type == SHADER_SGT || shader_type == SHADER_SGC || shader_type == SHADER_VGT || shader_type == SHADER_VGC);
+    t.textured = (texture != NULL);
+    t.texture = texture;
+    t.flat_color = v[0].c;
+    t.x0 = v[0].x;
+    t.y0 = v[0].y;
+
+    t.depth = visibility_plane(dx1, dy1, dx2, dy2, rcp_det, rcp_w0, rcp_w1, rcp_w2);
+    if (t.textured) {
+        t.u = visibility_plane(dx1, dy1, dx2, dy2, rcp_det, v[0].u * rcp_w0, v[1].u * rcp_w1, v[2].u * rcp_w2);
+        t.v = visibility_plane(dx1, dy1, dx2, dy2, rcp_det, v[0].v * rcp_w0, v[1].v * rcp_w1, v[2].v * rcp_w2);
+    }
+    if (t.gouraud) {
+        t.r = visibility_plane(dx1, dy1, dx2, dy2, rcp_det, ((v[0].c >> 16) & 0xFF) * rcp_w0, ((v[1].c >> 16) & 0xFF) * rcp_w1, ((v[2].c >> 16) & 0xFF) * rcp_w2);
+        t.g = visibility_plane(dx1, dy1, dx2, dy2, rcp_det, ((v[0].c >>  8) & 0xFF) * rcp_w0, ((v[1].c >>  8) & 0xFF) * rcp_w1, ((v[2].c >>  8) & 0xFF) * rcp_w2);
+        t.b = visibility_plane(dx1, dy1, dx2, dy2, rcp_det, ( v[0].c        & 0xFF) * rcp_w0, ( v[1].c        & 0xFF) * rcp_w1, ( v[2].c        & 0xFF) * rcp_w2);
+    }
+
+    array_push(ctx->visibility, t);
+    return (u32)array_length(ctx->visibility);
+}
+
+static inline u32 visibility_shade(const visibility_triangle_t* t, int x, int y, bool bilinear, mipmap_mode_t mipmap) {
+    const float fx = x + 0.5f - t->x0;
+    const float fy = y + 0.5f - t->y0;
+    const float inv_w = 1.0f / visibility_eval(&t->depth, fx, fy);
+
+    int r, g, b;
+    if (t->gouraud) {
+        r = (int)(visibility_eval(&t->r, fx, fy) * inv_w);
+        g = (int)(visibility_eval(&t->g, fx, fy) * inv_w);
+        b = (int)(visibility_eval(&t->b, fx, fy) * inv_w);
+    } else {
+        r = (t->flat_color >> 16) & 0xFF;
+        g = (t->flat_color >>  8) & 0xFF;
+        b =  t->flat_color        & 0xFF;
+    }
+
+    if (t->textured) {
+        const float u = visibility_eval(&t->u, fx, fy) * inv_w;
+        const float v = visibility_eval(&t->v, fx, fy) * inv_w;
+        const mipmap_mode_t mode = (t->texture->level_count > 1) ? mipmap : MIPMAP_NONE;
+        float lod = 0.0f;
+        if (mode != MIPMAP_NONE) {
+            lod = texture_lod(t->texture, (t->u.dx - u * t->depth.dx) * inv_w, (t->v.dx - v * t->depth.dx) * inv_w,
+                                          (t->u.dy - u * t->depth.dy) * inv_w, (t->v.dy - v * t->depth.dy) * inv_w);
+        }
+        const u32 texel = texture_sample(t->texture, mode, lod, u, v, bilinear);
+        r = ((int)( texel        & 0xFF) * r) >> 8;
+        g = ((int)((texel >>  8) & 0xFF) * g) >> 8;
+        b = ((int)((texel >> 16) & 0xFF) * b) >> 8;
+    }
+
+    r = (r < 0) ? 0 : (r > 255) ? 255 : r;
+    g = (g < 0) ? 0 : (g > 255) ? 255 : g;
+    b = (b < 0) ? 0 : (b > 255) ? 255 : b;
+    return 0xffu << 24 | r << 16 | g << 8 | b;
+}
+
+#if defined(__AVX2__) && defined(__FMA__)
+static inline __m256 visibility_eval_simd(const visibility_plane_t* p, __m256 fx, float fy) {
+    return _mm256_fmadd_ps(fx, _mm256_set1_ps(p->dx), _mm256_set1_ps(p->a + p->dy * fy));
+}
+
+// 8 horizontally adjacent pixels that all show the same triangle
+static inline __m256i visibility_shade_simd(const visibility_triangle_t* t, int x, int y, bool bilinear, mipmap_mode_t mipmap) {
+    const __m256 fx = _mm256_add_ps(_mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f), _mm256_set1_ps(x - t->x0));
+    const float fy = y + 0.5f - t->y0;
+    const __m256 inv_w = _mm256_div_ps(_mm256_set1_ps(1.0f), visibility_eval_simd(&t->depth, fx, fy));
+
+    __m256i r, g, b;
+    if (t->gouraud) {
+        r = _mm256_cvttps_epi32(_mm256_mul_ps(visibility_eval_simd(&t->r, fx, fy), inv_w));
+        g = _mm256_cvttps_epi32(_mm256_mul_ps(visibility_eval_simd(&t->g, fx, fy), inv_w));
+        b = _mm256_cvttps_epi32(_mm256_mul_ps(visibility_eval_simd(&t->b, fx, fy), inv_w));
+    } else {
+        r = _mm256_set1_epi32((t->flat_color >> 16) & 0xFF);
+        g = _mm256_set1_epi32((t->flat_color >>  8) & 0xFF);
+        b = _mm256_set1_epi32( t->flat_color        & 0xFF);
+    }
+
+    if (t->textured) {
+        const __m256 u = _mm256_mul_ps(visibility_eval_simd(&t->u, fx, fy), inv_w);
+        const __m256 v = _mm256_mul_ps(visibility_eval_simd(&t->v, fx, fy), inv_w);
+        const mipmap_mode_t mode = (t->texture->level_count > 1) ? mipmap : MIPMAP_NONE;
+        __m256 lod = _mm256_setzero_ps();
+        if (mode != MIPMAP_NONE) {
+            const __m256 depth_dx = _mm256_set1_ps(t->depth.dx);
+            const __m256 depth_dy = _mm256_set1_ps(t->depth.dy);
+            lod = simd_texture_lod(t->texture,
+                _mm256_mul_ps(_mm256_fnmadd_ps(u, depth_dx, _mm256_set1_ps(t->u.dx)), inv_w),
+                _mm256_mul_ps(_mm256_fnmadd_ps(v, depth_dx, _mm256_set1_ps(t->v.dx)), inv_w),
+                _mm256_mul_ps(_mm256_fnmadd_ps(u, depth_dy, _mm256_set1_ps(t->u.dy)), inv_w),
+                _mm256_mul_ps(_mm256_fnmadd_ps(v, depth_dy, _mm256_set1_ps(t->v.dy)), inv_w));
+        }
+        const __m256i texel = simd_sample(t->texture, mode, lod, u, v, bilinear);
+        const __m256i channel = _mm256_set1_epi32(0xFF);
+        r = _mm256_srai_epi32(_mm256_mullo_epi32(_mm256_and_si256(texel, channel), r), 8);
+        g = _mm256_srai_epi32(_mm256_mullo_epi32(_mm256_and_si256(_mm256_srli_epi32(texel,  8), channel), g), 8);
+        b = _mm256_srai_epi32(_mm256_mullo_epi32(_mm256_and_si256(_mm256_srli_epi32(texel, 16), channel), b), 8);
+    }
+
+    return simd_pack_rgb(simd_clamp_u8(r), simd_clamp_u8(g), simd_clamp_u8(b));
+}
+#endif // __AVX2__ && __FMA__
+
+void visibility_resolve(render_context* ctx, const raster_rect_t* rect) {
+    framebuffer_t* fb = &ctx->framebuffer;
+    const visibility_triangle_t* triangles = ctx->visibility;
+    const bool bilinear = ctx->bilinear_sampling;
+    const mipmap_mode_t mipmap = ctx->mipmap_mode;
+
+    for (int y = rect->min_y; y <= rect->max_y; y++) {
+        u32* ids = fb->id_buffer + y * fb->width;
+        u32* colors = fb->color_buffer + y * fb->width;
+
+        int x = rect->min_x;
+#if defined(__AVX2__) && defined(__FMA__)
+        // runs of 8 pixels covered by one triangle are shaded 8-wide, the
+        // rest (triangle edges, empty pixels) go through the scalar path
+        for (; x + 7 <= rect->max_x; x += 8) {
+            const __m256i id = _mm256_loadu_si256((const __m256i*)(ids + x));
+            const u32 first = ids[x];
+            const __m256i same = _mm256_cmpeq_epi32(id, _mm256_set1_epi32((int)first));
+            if (first == 0 || _mm256_movemask_epi8(same) != -1) {
+                for (int i = x; i < x + 8; i++) {
+                    if (ids[i] == 0) continue;
+                    colors[i] = visibility_shade(&triangles[ids[i] - 1], i, y, bilinear, mipmap);
+                    ids[i] = 0;
+                }
+                continue;
+            }
+            _mm256_storeu_si256((__m256i*)(colors + x), visibility_shade_simd(&triangles[first - 1], x, y, bilinear, mipmap));
+            _mm256_storeu_si256((__m256i*)(ids + x), _mm256_setzero_si256());
+        }
+#endif // __AVX2__ && __FMA__
+        for (; x <= rect->max_x; x++) {
+            if (ids[x] == 0) continue;
+            colors[x] = visibility_shade(&triangles[ids[x] - 1], x, y, bilinear, mipmap);
+            ids[x] = 0;
+        }
+    }
+}
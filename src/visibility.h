@@ -0,0 +1,36 @@
+#ifndef VISIBILITY_H
+#define VISIBILITY_H
+
+// visibility buffer (deferred texturing): the raster pass only writes depth
+// and a triangle id per pixel, the resolve then reconstructs the perspective
+// correct attributes from the triangle's screen-space planes and shades every
+// visible pixel exactly once, however many triangles were drawn over it
+
+#include "graphics.h"
+#include "tiles.h"
+
+// attribute plane in screen space, relative to the triangle's first vertex:
+// value(x, y) = a + dx * (x - x0) + dy * (y - y0)
+typedef struct {
+    float a, dx, dy;
+} visibility_plane_t;
+
+typedef struct visibility_triangle {
+    texture_t* texture;
+    bool gouraud;
+    bool textured;
+    u32 flat_color;
+
+    float x0, y0;
+    visibility_plane_t depth; // 1/w
+    visibility_plane_t u, v;  // u/w, v/w
+    visibility_plane_t r, g, b; // color / w, gouraud only
+} visibility_triangle_t;
+
+// returns the id written to the id buffer, 0 for degenerate triangles
+u32 visibility_add_triangle(render_context* ctx, shader_type_t shader_type, texture_t* texture, const raster_vertex_t v[3]);
+
+// shades and clears every pixel of the id buffer inside rect, usable as a tile_job_t
+void visibility_resolve(render_context* ctx, const raster_rect_t* rect);
+
+#endif // VISIBILITY_H